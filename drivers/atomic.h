@@ -0,0 +1,25 @@
+/*!
+ * \file      atomic.h
+ * \brief     Index publication and size checks shared by the queues.
+ *
+ * Queue, Ring and EventQueue all keep free-running head and tail
+ * counters in a power-of-two array. A producer publishes an index only
+ * after the slot has been written, and a consumer only after the slot
+ * has been read. On the Cortex-M4 the two macros below compile to a
+ * plain LDR/STR paired with a DMB.
+ */
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+/*! Reads \a p before any access that follows it. */
+#define ATOMIC_LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+
+/*! Writes \a v to \a p after every access that precedes it. */
+#define ATOMIC_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*! Rejects at compile time a \a size that is not a power of two. The
+ *  error names the type name_size_not_power_of_two. */
+#define POWER_OF_TWO_CHECK(name, size) \
+	typedef char name##_size_not_power_of_two[((size) > 0 && ((size) & ((size) - 1)) == 0) ? 1 : -1]
+
+#endif // ATOMIC_H
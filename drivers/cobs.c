@@ -0,0 +1,49 @@
+#include "cobs.h"
+
+uint32_t cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst) {
+	uint32_t code_index = 0; // Where the code for the current block goes
+	uint32_t out = 1;
+	uint8_t code = 1;        // One more than the bytes in the current block
+
+	while (len-- > 0) {
+		uint8_t c = *src++;
+
+		if (c != 0) {
+			dst[out++] = c;
+			code++;
+		}
+		if (c == 0 || code == 0xFF) {
+			dst[code_index] = code;
+			code_index = out++;
+			code = 1;
+		}
+	}
+	dst[code_index] = code;
+	return out;
+}
+
+int cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t *out_len) {
+	uint32_t in = 0;
+	uint32_t out = 0;
+
+	while (in < len) {
+		uint8_t code = src[in++];
+		uint8_t i;
+
+		if (code == 0 || in + code - 1 > len) {
+			return 0;
+		}
+		for (i = 1; i < code; i++) {
+			if (src[in] == 0) {
+				return 0;
+			}
+			dst[out++] = src[in++];
+		}
+		// A full block (0xFF) has no implied zero after it, nor has the last.
+		if (code != 0xFF && in < len) {
+			dst[out++] = 0;
+		}
+	}
+	*out_len = out;
+	return 1;
+}
@@ -0,0 +1,39 @@
+/*!
+ * \file      cobs.h
+ * \brief     Consistent Overhead Byte Stuffing.
+ *
+ * COBS rewrites a packet so that it contains no zero bytes, which
+ * leaves 0x00 free to mark where packets start and end on a byte
+ * stream such as a UART. Encoding adds one byte, plus one for every
+ * 254 bytes of input.
+ */
+#ifndef COBS_H
+#define COBS_H
+#include <stdint.h>
+
+/*! Largest encoded size of \a len bytes of input. */
+#define COBS_ENCODED_SIZE(len) ((len) + (len) / 254 + 1)
+
+/*! \brief Encodes a packet.
+ *  \param src  Packet to encode.
+ *  \param len  Number of bytes in \a src.
+ *  \param dst  Where the encoded bytes are written, at least
+ *              COBS_ENCODED_SIZE(\a len) bytes. Must not overlap \a src.
+ *  \return Number of bytes written to \a dst. No 0x00 delimiter is
+ *          added.
+ */
+uint32_t cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst);
+
+/*! \brief Decodes a packet.
+ *  The output is never longer than the input, so \a dst may be the
+ *  same buffer as \a src to decode in place.
+ *  \param src      Encoded bytes, without the 0x00 delimiter.
+ *  \param len      Number of bytes in \a src.
+ *  \param dst      Where the decoded packet is written.
+ *  \param out_len  Set to the length of the decoded packet.
+ *  \return True (1) if \a src was valid COBS, false (0) if it held a
+ *          zero byte or a code ran past its end.
+ */
+int cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t *out_len);
+
+#endif // COBS_H
@@ -0,0 +1,24 @@
+#include "platform.h"
+#include "crc.h"
+#include "STM32F4xx_RCC.h"
+#include <string.h>
+
+void crc_init(void) {
+	RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_CRC, ENABLE);
+}
+
+uint32_t crc_compute(const uint8_t *data, uint32_t len) {
+	uint32_t word;
+
+	CRC->CR = CRC_CR_RESET;
+	for (; len >= 4; data += 4, len -= 4) {
+		memcpy(&word, data, 4); // data may be unaligned
+		CRC->DR = word;
+	}
+	if (len > 0) {
+		word = 0;
+		memcpy(&word, data, len);
+		CRC->DR = word;
+	}
+	return CRC->DR;
+}
@@ -0,0 +1,28 @@
+/*!
+ * \file      crc.h
+ * \brief     CRC-32 checks using the hardware CRC unit.
+ *
+ * The unit computes the CRC-32/MPEG-2 variant: polynomial 0x04C11DB7,
+ * initial value 0xFFFFFFFF, no bit reflection and no final XOR, fed
+ * 32 bits at a time. Byte buffers are fed as little-endian words (as
+ * the CPU loads them), with the last word padded with zero bytes, so
+ * a host checking the same data has to do the same.
+ *
+ * The unit is shared; only call crc_compute() from one context.
+ */
+#ifndef CRC_H
+#define CRC_H
+#include <stdint.h>
+
+/*! \brief Enables the clock of the CRC unit.
+ */
+void crc_init(void);
+
+/*! \brief Computes the CRC-32 of a byte buffer.
+ *  \param data  Bytes to check. Need not be word aligned.
+ *  \param len   Number of bytes.
+ *  \return CRC of \a data, zero-padded to a whole number of words.
+ */
+uint32_t crc_compute(const uint8_t *data, uint32_t len);
+
+#endif // CRC_H
@@ -0,0 +1,18 @@
+#include "platform.h"
+#include "cycles.h"
+
+void cycles_init(void) {
+	// The DWT is part of the trace block, which has to be enabled
+	// before its registers can be written.
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t cycles_now(void) {
+	return DWT->CYCCNT;
+}
+
+uint32_t cycles_to_ns(uint32_t cycles) {
+	return (uint32_t)(((uint64_t)cycles * 1000000000ULL) / SystemCoreClock);
+}
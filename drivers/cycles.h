@@ -0,0 +1,35 @@
+/*!
+ * \file      cycles.h
+ * \brief     Cycle-accurate time stamps from the DWT cycle counter.
+ *
+ * Used to measure the cost of driver code (for example a
+ * queue_enqueue() in the UART receive interrupt) on the target:
+ *
+ *     uint32_t start = cycles_now();
+ *     queue_enqueue(&q, c);
+ *     uint32_t cost = cycles_now() - start;
+ *
+ * The counter runs at the core clock and wraps every 2^32 cycles,
+ * so differences are correct across one wrap.
+ */
+#ifndef CYCLES_H
+#define CYCLES_H
+#include <stdint.h>
+
+/*! \brief Enables and zeroes the DWT cycle counter.
+ */
+void cycles_init(void);
+
+/*! \brief Reads the cycle counter.
+ *  \return Core clock cycles since cycles_init().
+ */
+uint32_t cycles_now(void);
+
+/*! \brief Converts a number of cycles to nanoseconds at the
+ *         current core clock.
+ *  \param cycles  Number of cycles.
+ *  \return Duration in nanoseconds.
+ */
+uint32_t cycles_to_ns(uint32_t cycles);
+
+#endif // CYCLES_H
@@ -0,0 +1,113 @@
+#include "deadline_queue.h"
+
+// True if deadline a falls before deadline b, allowing for the
+// counter wrapping between them.
+static int deadline_before(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) < 0;
+}
+
+static void deadline_queue_swap(DeadlineQueue *queue, uint32_t i, uint32_t j) {
+	DeadlineEntry tmp = queue->heap[i];
+	queue->heap[i] = queue->heap[j];
+	queue->heap[j] = tmp;
+}
+
+static void deadline_queue_sift_up(DeadlineQueue *queue, uint32_t i) {
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+		if (!deadline_before(queue->heap[i].deadline, queue->heap[parent].deadline)) {
+			break;
+		}
+		deadline_queue_swap(queue, i, parent);
+		i = parent;
+	}
+}
+
+static void deadline_queue_sift_down(DeadlineQueue *queue, uint32_t i) {
+	for (;;) {
+		uint32_t left = 2 * i + 1;
+		uint32_t right = left + 1;
+		uint32_t smallest = i;
+
+		if (left < queue->count &&
+		    deadline_before(queue->heap[left].deadline, queue->heap[smallest].deadline)) {
+			smallest = left;
+		}
+		if (right < queue->count &&
+		    deadline_before(queue->heap[right].deadline, queue->heap[smallest].deadline)) {
+			smallest = right;
+		}
+		if (smallest == i) {
+			break;
+		}
+		deadline_queue_swap(queue, i, smallest);
+		i = smallest;
+	}
+}
+
+// Removes the earliest entry by moving the last entry into its
+// place and sifting it down.
+static void deadline_queue_remove_first(DeadlineQueue *queue) {
+	queue->count--;
+	queue->heap[0] = queue->heap[queue->count];
+	deadline_queue_sift_down(queue, 0);
+}
+
+void deadline_queue_init(DeadlineQueue *queue, DeadlineEntry *storage, uint32_t size) {
+	queue->heap = storage;
+	queue->count = 0;
+	queue->size = size;
+}
+
+int deadline_queue_insert(DeadlineQueue *queue, uint32_t deadline, uint32_t event) {
+	if (queue->count == queue->size) {
+		return 0;
+	}
+	queue->heap[queue->count].deadline = deadline;
+	queue->heap[queue->count].event = event;
+	deadline_queue_sift_up(queue, queue->count++);
+	return 1;
+}
+
+uint32_t deadline_queue_cancel(DeadlineQueue *queue, uint32_t event) {
+	uint32_t kept = 0;
+	uint32_t removed;
+	uint32_t i;
+
+	// Squeeze out the matching entries, then rebuild the heap
+	// bottom-up; both passes are O(n).
+	for (i = 0; i < queue->count; i++) {
+		if (queue->heap[i].event != event) {
+			queue->heap[kept++] = queue->heap[i];
+		}
+	}
+	removed = queue->count - kept;
+	queue->count = kept;
+	if (removed > 0) {
+		for (i = kept / 2; i-- > 0;) {
+			deadline_queue_sift_down(queue, i);
+		}
+	}
+	return removed;
+}
+
+void deadline_queue_clear(DeadlineQueue *queue) {
+	queue->count = 0;
+}
+
+const DeadlineEntry *deadline_queue_peek(DeadlineQueue *queue) {
+	return queue->count > 0 ? &queue->heap[0] : 0;
+}
+
+int deadline_queue_is_due(DeadlineQueue *queue, uint32_t now) {
+	return queue->count > 0 && !deadline_before(now, queue->heap[0].deadline);
+}
+
+int deadline_queue_pop_due(DeadlineQueue *queue, uint32_t now, uint32_t *event) {
+	if (!deadline_queue_is_due(queue, now)) {
+		return 0;
+	}
+	*event = queue->heap[0].event;
+	deadline_queue_remove_first(queue);
+	return 1;
+}
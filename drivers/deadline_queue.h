@@ -0,0 +1,95 @@
+/*!
+ * \file      deadline_queue.h
+ * \brief     Implements a priority queue of timed events.
+ *
+ * Holds (deadline, event) pairs in a binary min-heap so that the
+ * earliest deadline is always known in O(1), and inserting or
+ * removing an entry costs O(log n). Deadlines are compared with
+ * wrap-around arithmetic, so a free-running millisecond or cycle
+ * counter can be used directly as long as no two deadlines in the
+ * queue are more than 2^31 ticks apart.
+ *
+ * The queue is not interrupt-safe: it should only be used from one
+ * context, normally the main loop.
+ */
+#ifndef DEADLINE_QUEUE_H
+#define DEADLINE_QUEUE_H
+#include <stdint.h>
+
+/*! One timed event. */
+typedef struct {
+	uint32_t deadline; //!< Tick at which the event becomes due.
+	uint32_t event;    //!< Caller-defined event identifier.
+} DeadlineEntry;
+
+/*! This structure encapsulates the deadline queue data structure.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by deadline_queue.h.
+ */
+typedef struct {
+	DeadlineEntry* heap; //!< Heap-ordered array of entries.
+	uint32_t count;      //!< Number of entries in the heap.
+	uint32_t size;       //!< Capacity of the heap array.
+} DeadlineQueue;
+
+/*! \brief Defines a deadline queue called \a name holding up to
+ *         \a size entries in a static array.
+ *  The queue is ready to use without calling deadline_queue_init().
+ *  \param name  Name of the DeadlineQueue variable to define.
+ *  \param size  Amount of entries the queue can hold.
+ */
+#define DEADLINE_QUEUE_DEFINE(name, size) \
+	static DeadlineEntry name##_heap[(size)]; \
+	static DeadlineQueue name = { name##_heap, 0, (size) }
+
+/*! \brief Initialises the supplied queue to use a caller-provided array.
+ *  \param queue   DeadlineQueue structure to operate on.
+ *  \param storage Array of at least \a size entries.
+ *  \param size    Amount of entries the queue can hold.
+ */
+void deadline_queue_init(DeadlineQueue *queue, DeadlineEntry *storage, uint32_t size);
+
+/*! \brief Schedules an event.
+ *  \param queue    DeadlineQueue structure to operate on.
+ *  \param deadline Tick at which the event becomes due.
+ *  \param event    Event identifier.
+ *  \return True (1) if the operation is successful (i.e. the
+ *          queue isn't full), false (0) otherwise.
+ */
+int deadline_queue_insert(DeadlineQueue *queue, uint32_t deadline, uint32_t event);
+
+/*! \brief Removes every scheduled occurrence of an event.
+ *  \param queue DeadlineQueue structure to operate on.
+ *  \param event Event identifier to remove.
+ *  \return Number of entries removed.
+ */
+uint32_t deadline_queue_cancel(DeadlineQueue *queue, uint32_t event);
+
+/*! \brief Removes every entry.
+ *  \param queue DeadlineQueue structure to operate on.
+ */
+void deadline_queue_clear(DeadlineQueue *queue);
+
+/*! \brief Returns the earliest entry without removing it.
+ *  \param queue DeadlineQueue structure to operate on.
+ *  \return Pointer to the earliest entry, or 0 if the queue is empty.
+ */
+const DeadlineEntry *deadline_queue_peek(DeadlineQueue *queue);
+
+/*! \brief Checks if the earliest entry is due.
+ *  \param queue DeadlineQueue structure to operate on.
+ *  \param now   Current tick.
+ *  \return True (1) if an entry's deadline is at or before \a now,
+ *          false (0) otherwise.
+ */
+int deadline_queue_is_due(DeadlineQueue *queue, uint32_t now);
+
+/*! \brief Removes the earliest entry if it is due.
+ *  \param queue DeadlineQueue structure to operate on.
+ *  \param now   Current tick.
+ *  \param event Where the event identifier is stored, if successful.
+ *  \return True (1) if a due entry was removed, false (0) otherwise.
+ */
+int deadline_queue_pop_due(DeadlineQueue *queue, uint32_t now, uint32_t *event);
+
+#endif // DEADLINE_QUEUE_H
@@ -0,0 +1,151 @@
+#include "event_queue.h"
+#include <string.h>
+
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_7M__)
+#include "platform.h" // CMSIS __LDREXW, __STREXW and __CLREX, through core_cm4.h
+#endif
+
+static uint8_t *event_queue_slot(EventQueue *queue, uint32_t index) {
+	return &queue->data[(index & queue->mask) * queue->elem_size];
+}
+
+// Claims the next free slot, returning 0 if the queue is full.
+// The exclusive monitor is cleared on every exception entry and
+// return, so a producer that is preempted between the LDREX and
+// the STREX simply goes round the loop again.
+static int event_queue_claim(EventQueue *queue, uint32_t *position) {
+	uint32_t tail;
+
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_7M__)
+	do {
+		tail = __LDREXW(&queue->tail);
+		if (tail - ATOMIC_LOAD_ACQUIRE(&queue->head) > queue->mask) {
+			__CLREX();
+			return 0;
+		}
+	} while (__STREXW(tail + 1, &queue->tail) != 0);
+#else
+	tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	do {
+		if (tail - ATOMIC_LOAD_ACQUIRE(&queue->head) > queue->mask) {
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&queue->tail, &tail, tail + 1, 1,
+	                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+#endif
+	*position = tail;
+	return 1;
+}
+
+int event_queue_init(EventQueue *queue, void *storage, uint32_t *seq, uint32_t elem_size, uint32_t size) {
+	if (storage == 0 || seq == 0 || elem_size == 0 || size == 0 || (size & (size - 1)) != 0) {
+		return 0;
+	}
+
+	queue->data = (uint8_t*)storage;
+	queue->seq = seq;
+	queue->head = 0;
+	queue->tail = 0;
+	queue->mask = size - 1;
+	queue->elem_size = elem_size;
+	memset(seq, 0, sizeof(uint32_t) * size);
+	return 1;
+}
+
+int event_queue_post(EventQueue *queue, const void *event) {
+	uint32_t position;
+
+	if (!event_queue_claim(queue, &position)) {
+		return 0;
+	}
+	memcpy(event_queue_slot(queue, position), event, queue->elem_size);
+	ATOMIC_STORE_RELEASE(&queue->seq[position & queue->mask], position + 1);
+	return 1;
+}
+
+int event_queue_get(EventQueue *queue, void *event) {
+	uint32_t head = queue->head;
+
+	if (ATOMIC_LOAD_ACQUIRE(&queue->seq[head & queue->mask]) != head + 1) {
+		return 0;
+	}
+	memcpy(event, event_queue_slot(queue, head), queue->elem_size);
+	ATOMIC_STORE_RELEASE(&queue->head, head + 1);
+	return 1;
+}
+
+// In overwrite mode a slot's sequence word holds the position it was
+// last written for, shifted up one bit, with bit 0 set once the event
+// in the slot is complete. No value means "empty", so there is nothing
+// for a position to collide with when it wraps. The reader checks the
+// word again after copying the event out, so an event overwritten
+// mid-copy is detected and skipped.
+#define OVERWRITE_WRITING(position) ((uint32_t)(position) << 1)
+#define OVERWRITE_READY(position)   (((uint32_t)(position) << 1) | 1)
+
+void event_queue_post_overwrite(EventQueue *queue, const void *event) {
+	// A single atomic increment (LDREX/STREX on the Cortex-M4) claims
+	// the slot whatever the reader is doing.
+	uint32_t position = __atomic_fetch_add(&queue->tail, 1, __ATOMIC_RELAXED);
+	uint32_t *seq = &queue->seq[position & queue->mask];
+	uint32_t writing = OVERWRITE_WRITING(position);
+
+	ATOMIC_STORE_RELEASE(seq, writing);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(event_queue_slot(queue, position), event, queue->elem_size);
+	// Publish only if the slot is still ours. If newer writers lapped us
+	// while we were preempted, our copy has overwritten part of a newer
+	// event: mark the slot as holding nothing complete instead, so the
+	// reader skips it rather than return a mixture of the two.
+	if (!__atomic_compare_exchange_n(seq, &writing, OVERWRITE_READY(position), 0,
+	                                 __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		ATOMIC_STORE_RELEASE(seq, OVERWRITE_WRITING(position));
+	}
+}
+
+int event_queue_get_overwrite(EventQueue *queue, void *event, uint32_t *missed) {
+	uint32_t head = queue->head;
+
+	for (;;) {
+		uint32_t tail = ATOMIC_LOAD_ACQUIRE(&queue->tail);
+		uint32_t *seq = &queue->seq[head & queue->mask];
+		uint32_t mark;
+
+		if (tail == head) {
+			return 0;
+		}
+		// The writers have lapped us: skip to the oldest slot that can
+		// still hold an unread event.
+		if (tail - head > queue->mask + 1) {
+			*missed += tail - head - (queue->mask + 1);
+			head = tail - (queue->mask + 1);
+			ATOMIC_STORE_RELEASE(&queue->head, head);
+			continue;
+		}
+		mark = ATOMIC_LOAD_ACQUIRE(seq);
+		if (mark != OVERWRITE_READY(head)) {
+			// The slot does not hold a complete event for this
+			// position: its writer was lapped, or (with the reader on
+			// another core or thread) has not finished yet. Waiting
+			// could stall the reader until the next lap, so count the
+			// event as missed and move on.
+			(*missed)++;
+			head++;
+			ATOMIC_STORE_RELEASE(&queue->head, head);
+			continue;
+		}
+		memcpy(event, event_queue_slot(queue, head), queue->elem_size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(seq, __ATOMIC_RELAXED) != mark) {
+			continue; // Overwritten while copying; skipped on the next pass
+		}
+		ATOMIC_STORE_RELEASE(&queue->head, head + 1);
+		return 1;
+	}
+}
+
+int event_queue_is_empty(EventQueue *queue) {
+	uint32_t head = queue->head;
+
+	return ATOMIC_LOAD_ACQUIRE(&queue->seq[head & queue->mask]) != head + 1;
+}
@@ -0,0 +1,114 @@
+/*!
+ * \file      event_queue.h
+ * \brief     Implements a multi-producer FIFO of fixed-size events.
+ *
+ * Any number of interrupt handlers, at any priority, may post to the
+ * same event queue while a single consumer (the main loop) takes
+ * events off it. Posting is lock-free: a slot is claimed with an
+ * LDREX/STREX loop on the Cortex-M4, so interrupts never need to be
+ * disabled. Only the consumer may call event_queue_get() and
+ * event_queue_is_empty().
+ *
+ * A queue can instead be run in overwrite mode, for logs where the
+ * newest entries matter most: event_queue_post_overwrite() never
+ * fails and replaces the oldest entry when the queue is full, and
+ * event_queue_get_overwrite() reports how many entries the reader
+ * lost that way. A queue must only be used in one of the two modes.
+ */
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+#include <stdint.h>
+#include "atomic.h"
+
+/*! This structure encapsulates the event queue data structure.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by event_queue.h.
+ *
+ *  Each slot has a sequence word which the producer sets to its
+ *  claimed position plus one once the event has been written. A
+ *  producer that is preempted between claiming and publishing its
+ *  slot only delays the events behind it; none are lost. In overwrite
+ *  mode the word also tells the reader when a producer was lapped
+ *  while preempted, and the slot is skipped and counted as missed.
+ */
+typedef struct {
+	uint8_t* data;      //!< Array of events.
+	uint32_t* seq;      //!< Per-slot publish marks, one per event.
+	uint32_t head;      //!< Count of events removed, written only by the consumer.
+	uint32_t tail;      //!< Count of slots claimed by producers.
+	uint32_t mask;      //!< Number of events in the array minus one.
+	uint32_t elem_size; //!< Size of one event in bytes.
+} EventQueue;
+
+/*! \brief Defines an event queue called \a name holding up to
+ *         \a size events of type \a type in static arrays.
+ *  The queue is ready to use without calling event_queue_init().
+ *  A \a size that is not a power of two is rejected at compile time.
+ *  \param name  Name of the EventQueue variable to define.
+ *  \param type  Type of one event.
+ *  \param size  Amount of events the queue can hold.
+ */
+#define EVENT_QUEUE_DEFINE(name, type, size) \
+	POWER_OF_TWO_CHECK(name, size); \
+	static type name##_data[(size)]; \
+	static uint32_t name##_seq[(size)]; \
+	static EventQueue name = { (uint8_t*)name##_data, name##_seq, 0, 0, (size) - 1, sizeof(type) }
+
+/*! \brief Initialises the supplied event queue to use caller-provided arrays.
+ *  \param queue     EventQueue structure to operate on.
+ *  \param storage   Array of at least \a size events.
+ *  \param seq       Array of \a size sequence words.
+ *  \param elem_size Size of one event in bytes.
+ *  \param size      Amount of events the queue can hold. Must be a
+ *                   power of two.
+ *  \return True (1) if the operation is successful, false (0)
+ *          otherwise.
+ */
+int event_queue_init(EventQueue *queue, void *storage, uint32_t *seq, uint32_t elem_size, uint32_t size);
+
+/*! \brief Copies an event to the back of the queue.
+ *  Safe to call from any context, including nested interrupts.
+ *  \param queue EventQueue structure to operate on.
+ *  \param event Event to add.
+ *  \return True (1) if the operation is successful (i.e. the
+ *          queue isn't full), false (0) otherwise.
+ */
+int event_queue_post(EventQueue *queue, const void *event);
+
+/*! \brief Copies out and removes the event at the front of the queue.
+ *  \param queue EventQueue structure to operate on.
+ *  \param event Where the event should be stored, if successful.
+ *  \return True (1) if an event was removed, false (0) if none is
+ *          ready yet.
+ */
+int event_queue_get(EventQueue *queue, void *event);
+
+/*! \brief Copies an event to the back of the queue, overwriting the
+ *         oldest event if the queue is full.
+ *  Never waits for the reader, so it is safe to call from any
+ *  interrupt handler.
+ *  \param queue EventQueue structure to operate on.
+ *  \param event Event to add.
+ */
+void event_queue_post_overwrite(EventQueue *queue, const void *event);
+
+/*! \brief Copies out and removes the oldest event still held by a
+ *         queue that is written with event_queue_post_overwrite().
+ *  \param queue  EventQueue structure to operate on.
+ *  \param event  Where the event should be stored, if successful.
+ *  \param missed Incremented by the number of events that were
+ *                overwritten before they could be read, or whose
+ *                writer had not finished when the reader got to them.
+ *  \return True (1) if an event was removed, false (0) if the queue
+ *          is empty.
+ */
+int event_queue_get_overwrite(EventQueue *queue, void *event, uint32_t *missed);
+
+/*! \brief Checks if an event is ready to be taken off the queue.
+ *  Only for a queue used with event_queue_post().
+ *  \param queue EventQueue structure to operate on.
+ *  \return True (1) if no event is ready, false (0) otherwise.
+ */
+int event_queue_is_empty(EventQueue *queue);
+
+#endif // EVENT_QUEUE_H
@@ -0,0 +1,151 @@
+#include "platform.h"
+#include "log.h"
+#include "cobs.h"
+#include <stdarg.h>
+#include <string.h>
+
+typedef char log_record_size_too_big[LOG_RECORD_SIZE < 128 ? 1 : -1];
+
+uint8_t log_level = LOG_LEVEL;
+
+static Uart *log_uart;
+static const volatile uint32_t *log_clock;
+static uint32_t log_last_time;
+
+// Errors, warnings and information are not held up behind debug output.
+static UartChannel log_channel(uint8_t level) {
+	return level <= LOG_LEVEL_INFO ? UART_CHANNEL_STATUS : UART_CHANNEL_VERBOSE;
+}
+
+void log_init(Uart *uart) {
+	log_uart = uart;
+#if LOG_BINARY
+	// A record cut short would corrupt the decoding of the next, so
+	// records are only ever sent whole or not at all.
+	uart_set_tx_policy(uart, LOG_RECORD_CHANNEL, UART_TX_DROP);
+#endif
+}
+
+void log_set_clock(const volatile uint32_t *ms) {
+	log_clock = ms;
+	log_last_time = ms ? *ms : 0;
+}
+
+uint8_t log_set_level(uint8_t level) {
+	log_level = level < LOG_LEVEL ? level : LOG_LEVEL;
+	return log_level;
+}
+
+uint8_t log_get_level(void) {
+	return log_level;
+}
+
+void log_printf(uint8_t level, const char *format, ...) {
+	va_list args;
+
+	if (log_uart == 0) {
+		return;
+	}
+	va_start(args, format);
+	uart_channel_vprintf(log_uart, log_channel(level), format, args);
+	va_end(args);
+}
+
+#if LOG_BINARY
+// Start of the log_messages section, from which message IDs are counted
+// so that they stay short. Both linkers define it for a named section,
+// so only binary builds, which have one, may refer to it.
+#if defined(__ARMCC_VERSION)
+extern const uint8_t log_messages_start[] __asm("log_messages$$Base");
+#else
+extern const uint8_t log_messages_start[] __asm("__start_log_messages");
+#endif
+
+// Writes \a value as an unsigned LEB128 varint, returning its length.
+static uint32_t log_put_varint(uint8_t *p, uint32_t value) {
+	uint32_t length = 0;
+
+	while (value >= 0x80) {
+		p[length++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	p[length++] = (uint8_t)value;
+	return length;
+}
+
+void log_record(const uint8_t *message, ...) {
+	const char *format = (const char *)message + 1;
+	uint8_t record[LOG_RECORD_SIZE];
+	uint8_t frame[COBS_ENCODED_SIZE(LOG_RECORD_SIZE) + 2];
+	uint32_t length;
+	uint32_t now;
+	va_list args;
+	int is_long;
+
+	if (log_uart == 0) {
+		return;
+	}
+	now = log_clock ? *log_clock : 0;
+	length = log_put_varint(record, (uint32_t)(message - log_messages_start));
+	length += log_put_varint(record + length, now - log_last_time);
+	log_last_time = now;
+
+	// Only the conversions are looked at; the text stays in flash.
+	va_start(args, message);
+	for (; *format != '\0'; format++) {
+		if (*format != '%') {
+			continue;
+		}
+		format++;
+		is_long = (*format == 'l');
+		if (is_long) {
+			format++;
+		}
+		if (length > LOG_RECORD_SIZE - 5) {
+			break; // No room for another varint
+		}
+		switch (*format) {
+		case 'c':
+			length += log_put_varint(record + length, (uint8_t)va_arg(args, int));
+			break;
+		case 'd': {
+			int32_t value = is_long ? (int32_t)va_arg(args, long) : va_arg(args, int);
+			// Zigzag, so that small negative numbers stay short.
+			length += log_put_varint(record + length, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+			break;
+		}
+		case 'u':
+		case 'x': {
+			uint32_t value = is_long ? (uint32_t)va_arg(args, unsigned long) : va_arg(args, unsigned int);
+			length += log_put_varint(record + length, value);
+			break;
+		}
+		case 's': {
+			const char *string = va_arg(args, const char *);
+			uint32_t string_length = strlen(string);
+
+			// LOG_RECORD_SIZE is under 128, so the length is one byte.
+			if (string_length > LOG_RECORD_SIZE - length - 1) {
+				string_length = LOG_RECORD_SIZE - length - 1;
+			}
+			record[length++] = (uint8_t)string_length;
+			memcpy(record + length, string, string_length);
+			length += string_length;
+			break;
+		}
+		case '\0':
+			format--;
+			break;
+		default:
+			// '%%' and anything unsupported take no argument.
+			break;
+		}
+	}
+	va_end(args);
+
+	frame[0] = 0x00;
+	length = cobs_encode(record, length, frame + 1);
+	frame[length + 1] = 0x00;
+	uart_channel_write(log_uart, LOG_RECORD_CHANNEL, frame, length + 2);
+}
+#endif // LOG_BINARY
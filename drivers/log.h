@@ -0,0 +1,172 @@
+/*!
+ * \file      log.h
+ * \brief     Levelled diagnostic messages on a UART.
+ *
+ * Every message has a level, from LOG_LEVEL_ERROR (most important) to
+ * LOG_LEVEL_TRACE. Messages above LOG_LEVEL are removed at compile
+ * time, arguments and all. The rest are printed only while their level
+ * is within the runtime level set with log_set_level(), which costs
+ * one comparison for a message that is not printed.
+ *
+ * As text, errors, warnings and information go on UART_CHANNEL_STATUS;
+ * debug and trace messages on UART_CHANNEL_VERBOSE, so they give way
+ * when the link is busy. Messages are formatted with the printf subset
+ * of uart_printf().
+ *
+ * With LOG_BINARY the firmware does no formatting. Each message's
+ * level and format string are stored in flash in the log_messages
+ * section, and a message is sent as a record holding the varint
+ * (LEB128) encoded:
+ *   - message ID: offset of the stored message in the log_messages
+ *     section, so one or two bytes for all but very chatty builds;
+ *   - milliseconds since the previous record (see log_set_clock());
+ *   - each argument in format order: %d zigzag encoded, %c, %u and %x
+ *     as they are, %s as its length followed by its bytes.
+ * The record is COBS encoded between two 0x00 bytes, so it can share
+ * the UART with plain text, which never contains 0x00.
+ * Format strings must then be string literals. tools/logdecode.py
+ * rebuilds the text from the .axf file of the build.
+ *
+ * Records of every level go on LOG_RECORD_CHANNEL, which log_init()
+ * sets to UART_TX_DROP: a record that does not fit is dropped whole.
+ * The blocking and coalescing policies can cut a record short (from an
+ * interrupt handler, or when the block already being sent is kept),
+ * which the decoder can only skip, losing the record after it too.
+ */
+#ifndef LOG_H
+#define LOG_H
+#include <stdint.h>
+#include "uart.h"
+
+#define LOG_LEVEL_NONE  0 //!< Nothing is printed.
+#define LOG_LEVEL_ERROR 1 //!< Something failed.
+#define LOG_LEVEL_WARN  2 //!< Bad input or a recoverable problem.
+#define LOG_LEVEL_INFO  3 //!< Results and changes of mode.
+#define LOG_LEVEL_DEBUG 4 //!< Progress of each step.
+#define LOG_LEVEL_TRACE 5 //!< Internal state changes.
+
+/*! Highest level compiled in, and the runtime level at start-up. Define
+ *  it in the project settings, e.g. LOG_LEVEL=LOG_LEVEL_WARN for a
+ *  quiet build. */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/*! Set to 1 to send messages as binary records instead of text. */
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+/*! Channel binary records are sent on. */
+#ifndef LOG_RECORD_CHANNEL
+#define LOG_RECORD_CHANNEL UART_CHANNEL_VERBOSE
+#endif
+
+/*! Longest binary record before COBS encoding. Arguments that do not
+ *  fit are left out, and a long %s argument is cut short. */
+#ifndef LOG_RECORD_SIZE
+#define LOG_RECORD_SIZE 48
+#endif
+
+/*! Runtime level; change it with log_set_level(). Exposed only so the
+ *  LOG_ macros can test it without a call. */
+extern uint8_t log_level;
+
+/*! \brief Selects the UART messages are printed on. Until this is
+ *         called messages are discarded. With LOG_BINARY this also
+ *         sets LOG_RECORD_CHANNEL to drop records that do not fit.
+ *  \param uart  UART structure to print on.
+ */
+void log_init(Uart *uart);
+
+/*! \brief Selects the millisecond counter that binary records are
+ *         timestamped from. Until this is called every delta is zero.
+ *  \param ms  Counter to read. It must keep running while the
+ *             application sleeps or stops its tick, as the one from
+ *             timer_ms_clock_init() does, or the deltas leave that
+ *             time out. 0 for none.
+ */
+void log_set_clock(const volatile uint32_t *ms);
+
+/*! \brief Sets the runtime level.
+ *  \param level  Highest level to print, LOG_LEVEL_NONE to
+ *                LOG_LEVEL_TRACE. Levels above LOG_LEVEL were
+ *                compiled out, so it is limited to that.
+ *  \return The level now in effect.
+ */
+uint8_t log_set_level(uint8_t level);
+
+/*! \brief Gets the runtime level.
+ *  \return Highest level being printed.
+ */
+uint8_t log_get_level(void);
+
+/*! \brief Prints a message regardless of the runtime level. Use the
+ *         LOG_ macros instead.
+ *  \param level   Level of the message, which selects its channel.
+ *  \param format  Format string, as for uart_printf().
+ */
+void log_printf(uint8_t level, const char *format, ...);
+
+/*! \brief Sends a binary record for a message. Use the LOG_ macros
+ *         instead. Only built with LOG_BINARY.
+ *  \param message  Stored message: its level, then its NUL terminated
+ *                  format string.
+ */
+void log_record(const uint8_t *message, ...);
+
+#if LOG_BINARY
+/*! \brief Sends a message if \a level is within the runtime level.
+ *  Pasting "" in front of \a format makes anything but a string
+ *  literal a compile error, rather than the size of a pointer. */
+#define LOG_AT(level, format, ...) \
+	do { \
+		if ((level) <= log_level) { \
+			static const struct { \
+				uint8_t severity; \
+				char text[sizeof("" format)]; \
+			} log_message __attribute__((section("log_messages"))) = { (level), "" format }; \
+			log_record(&log_message.severity, ##__VA_ARGS__); \
+		} \
+	} while (0)
+#else
+/*! \brief Prints a message if \a level is within the runtime level. */
+#define LOG_AT(level, ...) \
+	do { \
+		if ((level) <= log_level) { \
+			log_printf((level), __VA_ARGS__); \
+		} \
+	} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#endif // LOG_H
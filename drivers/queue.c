@@ -1,42 +1,102 @@
 #include "queue.h"
 #include <stdlib.h>
+#include <string.h>
 
-int queue_init(Queue *queue, uint32_t size) {
-	queue->data = (uint8_t*)malloc(sizeof(uint8_t) * size);
+int queue_init_static(Queue *queue, uint8_t *storage, uint32_t size) {
+	// Masking only wraps correctly for power of two sizes.
+	if (storage == 0 || size == 0 || (size & (size - 1)) != 0) {
+		return 0;
+	}
+
+	queue->data = storage;
 	queue->head = 0;
 	queue->tail = 0;
-	queue->size = size;
-	
-	// If malloc returns NULL (0) the allocation has failed.
-	return queue->data != 0;
+	queue->mask = size - 1;
+#ifdef QUEUE_STATS
+	queue_reset_stats(queue);
+#endif
+	return 1;
 }
 
-int queue_enqueue(Queue *queue, uint8_t item) {
-	if (!queue_is_full(queue)) {
-		queue->data[queue->tail++] = item;
-		queue->tail %= queue->size;
-		return 1;
-	} else {
+int queue_init(Queue *queue, uint32_t size) {
+	if (size == 0 || (size & (size - 1)) != 0) {
 		return 0;
 	}
+
+	// If malloc returns NULL (0) the allocation has failed.
+	return queue_init_static(queue, (uint8_t*)malloc(sizeof(uint8_t) * size), size);
 }
 
-int queue_dequeue(Queue *queue, uint8_t *item) {
-	if (!queue_is_empty(queue)) {
-		*item = queue->data[queue->head++];
-		queue->head %= queue->size;
-		return 1;
-	} else {
-		return 0;
+uint32_t queue_enqueue_n(Queue *queue, const uint8_t *items, uint32_t count) {
+	uint32_t tail = queue->tail;
+	uint32_t used = tail - ATOMIC_LOAD_ACQUIRE(&queue->head);
+	uint32_t space = queue->mask + 1 - used;
+	uint32_t index = tail & queue->mask;
+	uint32_t requested = count;
+	uint32_t first;
+
+	if (count > space) {
+		count = space;
+	}
+	// Copy up to the end of the array, then wrap to the start.
+	first = queue->mask + 1 - index;
+	if (first > count) {
+		first = count;
 	}
+	memcpy(&queue->data[index], items, first);
+	memcpy(queue->data, items + first, count - first);
+	ATOMIC_STORE_RELEASE(&queue->tail, tail + count);
+	QUEUE_STATS_ADD(queue, requested, count, used + count);
+	return count;
+}
+
+uint32_t queue_dequeue_n(Queue *queue, uint8_t *items, uint32_t count) {
+	uint32_t head = queue->head;
+	uint32_t used = ATOMIC_LOAD_ACQUIRE(&queue->tail) - head;
+	uint32_t index = head & queue->mask;
+	uint32_t first;
+
+	if (count > used) {
+		count = used;
+	}
+	first = queue->mask + 1 - index;
+	if (first > count) {
+		first = count;
+	}
+	memcpy(items, &queue->data[index], first);
+	memcpy(items + first, queue->data, count - first);
+	ATOMIC_STORE_RELEASE(&queue->head, head + count);
+	QUEUE_STATS_REMOVE(queue, count);
+	return count;
+}
+
+uint32_t queue_peek_contiguous(Queue *queue, const uint8_t **region) {
+	uint32_t head = queue->head;
+	uint32_t used = ATOMIC_LOAD_ACQUIRE(&queue->tail) - head;
+	uint32_t index = head & queue->mask;
+	uint32_t first = queue->mask + 1 - index;
+
+	*region = &queue->data[index];
+	return used < first ? used : first;
+}
+
+void queue_commit(Queue *queue, uint32_t count) {
+	ATOMIC_STORE_RELEASE(&queue->head, queue->head + count);
+	QUEUE_STATS_REMOVE(queue, count);
+}
+
+void queue_truncate(Queue *queue, uint32_t keep) {
+	ATOMIC_STORE_RELEASE(&queue->tail, queue->head + keep);
 }
 
-int queue_is_full(Queue *queue) {
-	return ((queue->tail + 1) % queue->size) == queue->head;
+#ifdef QUEUE_STATS
+void queue_get_stats(Queue *queue, QueueStats *stats) {
+	memcpy(stats, &queue->stats, sizeof(QueueStats));
 }
 
-int queue_is_empty(Queue *queue) {
-	return queue->tail == queue->head;
+void queue_reset_stats(Queue *queue) {
+	memset(&queue->stats, 0, sizeof(QueueStats));
 }
+#endif
 
-// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************   
+// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************
@@ -2,27 +2,119 @@
  * \file      queue.h
  * \brief     Implements a queue (FIFO) data structure.
  * \copyright ARM University Program &copy; ARM Ltd 2014.
+ *
+ * The queue is a single-producer / single-consumer ring buffer and
+ * is lock-free: one context (e.g. an interrupt handler) may enqueue
+ * while another (e.g. the main loop) dequeues, without disabling
+ * interrupts. Only the producer may call queue_enqueue(),
+ * queue_enqueue_n() and queue_is_full(); only the consumer may
+ * call queue_dequeue(), queue_dequeue_n(), queue_peek_contiguous()
+ * and queue_commit().
+ *
+ * Defining QUEUE_STATS adds occupancy counters to every queue (see
+ * queue_get_stats()). Without it the counters compile away.
+ *
+ * The single-item operations, and the statistics update they make,
+ * are defined in this header and forced inline, so an interrupt
+ * handler enqueueing a byte costs a few loads and stores rather than
+ * a function call. A plain static inline is not enough for that: the
+ * project's unoptimised build does not inline at all.
  */
 #ifndef QUEUE_H
 #define QUEUE_H
 #include <stdint.h>
+#include "atomic.h"
+
+#ifdef QUEUE_STATS
+/*! Number of buckets in the occupancy histogram. */
+#define QUEUE_STATS_BUCKETS 8
+
+/*! Occupancy counters kept per queue when QUEUE_STATS is defined.
+ *  Each counter is written by one side only, so they need no locking.
+ */
+typedef struct {
+	uint32_t enqueued; //!< Items successfully added.
+	uint32_t dequeued; //!< Items removed.
+	uint32_t dropped;  //!< Items rejected because the queue was full.
+	uint32_t peak;     //!< Highest occupancy seen.
+	uint32_t histogram[QUEUE_STATS_BUCKETS]; //!< Occupancy after each add, in equal slices of the size.
+} QueueStats;
+#endif
 
 /*! This structure encapsulates the queue data structure.
  *  It should not be modified directly. Any modifications should
  *  be carried out by the functions provided by queue.h.
+ *
+ *  \a head and \a tail are free-running counters; they are only
+ *  reduced to an array index (by masking) when the data array is
+ *  accessed, so all \a mask + 1 slots are usable.
  */
 typedef struct {
-	uint8_t* data; //!< Array of data, stored on the heap.
-	uint32_t head; //!< Index in the array of the oldest element.
-	uint32_t tail; //!< Index in the array of the youngest element.
-	uint32_t size; //!< Size of the data array.
+	uint8_t* data; //!< Array of data, on the heap or in static storage.
+	uint32_t head; //!< Count of elements removed, written only by the consumer.
+	uint32_t tail; //!< Count of elements added, written only by the producer.
+	uint32_t mask; //!< Size of the data array minus one.
+#ifdef QUEUE_STATS
+	QueueStats stats; //!< Occupancy counters.
+#endif
 } Queue;
 
+// Inlined at every optimisation level, including -O0.
+#define QUEUE_INLINE static inline __attribute__((always_inline))
+
+#ifdef QUEUE_STATS
+// Producer side: accounts for an add of `requested` items of which
+// `added` fitted, leaving `used` items in the queue.
+QUEUE_INLINE void queue_stats_add(Queue *queue, uint32_t requested, uint32_t added, uint32_t used) {
+	QueueStats *stats = &queue->stats;
+
+	stats->enqueued += added;
+	stats->dropped += requested - added;
+	if (used > stats->peak) {
+		stats->peak = used;
+	}
+	if (used > 0) {
+		stats->histogram[((used - 1) * QUEUE_STATS_BUCKETS) / (queue->mask + 1)]++;
+	}
+}
+#define QUEUE_STATS_ADD(queue, requested, added, used) queue_stats_add((queue), (requested), (added), (used))
+#define QUEUE_STATS_REMOVE(queue, removed)             ((queue)->stats.dequeued += (removed))
+#else
+#define QUEUE_STATS_ADD(queue, requested, added, used) ((void)(requested))
+#define QUEUE_STATS_REMOVE(queue, removed)             ((void)0)
+#endif
+
+/*! \brief Defines a queue called \a name whose data array is a
+ *         static array of \a size elements.
+ *  The queue is ready to use without calling queue_init() and
+ *  takes no heap memory. A \a size that is not a power of two
+ *  is rejected at compile time.
+ *  \param name  Name of the Queue variable to define.
+ *  \param size  Amount of elements the queue can hold.
+ */
+#define QUEUE_DEFINE(name, size) \
+	POWER_OF_TWO_CHECK(name, size); \
+	static uint8_t name##_data[(size)]; \
+	static Queue name = { name##_data, 0, 0, (size) - 1 }
+
+/*! \brief Initialises the supplied queue structure to use a
+ *         caller-provided data array.
+ *  \param queue   Queue structure to operate on.
+ *  \param storage Array of at least \a size elements which must
+ *                 outlive the queue.
+ *  \param size    Amount of elements the queue can hold. Must be
+ *                 a power of two.
+ *  \return True (1) if the operation is successful, false (0)
+ *          otherwise.
+ */
+int queue_init_static(Queue *queue, uint8_t *storage, uint32_t size);
+
 /*! \brief Initialises the supplied queue structure to the
- *         parameterised size.
+ *         parameterised size, allocating the data array on the heap.
  *  This must be called before any use of the data-structure.
  *  \param queue Queue structure to operate on.
- *  \param size  Amount of elements the queue can hold.
+ *  \param size  Amount of elements the queue can hold. Must be
+ *               a power of two.
  *  \return True (1) if the operation is successful, false (0)
  *          otherwise.
  */
@@ -34,7 +126,19 @@ int queue_init(Queue *queue, uint32_t size);
  *  \return True (1) if the operation is successful (i.e. the
  *          queue isn't full), false (0) otherwise.
  */
-int queue_enqueue(Queue *queue, uint8_t item);
+QUEUE_INLINE int queue_enqueue(Queue *queue, uint8_t item) {
+	uint32_t tail = queue->tail;
+	uint32_t used = tail - ATOMIC_LOAD_ACQUIRE(&queue->head);
+
+	if (used > queue->mask) {
+		QUEUE_STATS_ADD(queue, 1, 0, used);
+		return 0;
+	}
+	queue->data[tail & queue->mask] = item;
+	ATOMIC_STORE_RELEASE(&queue->tail, tail + 1);
+	QUEUE_STATS_ADD(queue, 1, 1, used + 1);
+	return 1;
+}
 
 /*! \brief Removes the item at the front of the queue.
  *  \param queue Queue structure to operate on.
@@ -43,21 +147,102 @@ int queue_enqueue(Queue *queue, uint8_t item);
  *  \return True (1) if the operation is successful (i.e. the
  *          queue isn't empty), false (0) otherwise.
  */
-int queue_dequeue(Queue *queue, uint8_t *item);
+QUEUE_INLINE int queue_dequeue(Queue *queue, uint8_t *item) {
+	uint32_t head = queue->head;
+
+	if (ATOMIC_LOAD_ACQUIRE(&queue->tail) == head) {
+		return 0;
+	}
+	*item = queue->data[head & queue->mask];
+	ATOMIC_STORE_RELEASE(&queue->head, head + 1);
+	QUEUE_STATS_REMOVE(queue, 1);
+	return 1;
+}
+
+/*! \brief Adds up to \a count items to the back of the queue.
+ *  The items are copied in at most two blocks (before and after
+ *  the wrap point of the data array).
+ *  \param queue Queue structure to operate on.
+ *  \param items Items to add to the queue.
+ *  \param count Number of items to add.
+ *  \return Number of items actually added, which is less than
+ *          \a count if the queue became full.
+ */
+uint32_t queue_enqueue_n(Queue *queue, const uint8_t *items, uint32_t count);
+
+/*! \brief Removes up to \a count items from the front of the queue.
+ *  \param queue Queue structure to operate on.
+ *  \param items Array the removed items are stored in.
+ *  \param count Maximum number of items to remove.
+ *  \return Number of items actually removed.
+ */
+uint32_t queue_dequeue_n(Queue *queue, uint8_t *items, uint32_t count);
+
+/*! \brief Exposes the items at the front of the queue in place.
+ *  Only the part of the queue that is contiguous in memory is
+ *  returned; once it has been committed the remainder (if any)
+ *  becomes available through another call.
+ *  \param queue  Queue structure to operate on.
+ *  \param region Set to point at the oldest item in the queue.
+ *  \return Number of items readable through \a region.
+ */
+uint32_t queue_peek_contiguous(Queue *queue, const uint8_t **region);
+
+/*! \brief Removes items previously exposed by queue_peek_contiguous().
+ *  \param queue Queue structure to operate on.
+ *  \param count Number of items to remove, no more than the
+ *               last peek returned.
+ */
+void queue_commit(Queue *queue, uint32_t count);
+
+/*! \brief Discards the newest items, keeping the oldest \a keep.
+ *  Called by the producer to take back items it added. The consumer
+ *  must not be running meanwhile (e.g. its interrupt is masked), as
+ *  it may already be reading them.
+ *  \param queue Queue structure to operate on.
+ *  \param keep  Number of items to keep; no more than are queued.
+ */
+void queue_truncate(Queue *queue, uint32_t keep);
+
+/*! \brief Returns the number of items in the supplied queue.
+ *  \param queue Queue structure to operate on.
+ *  \return Number of items in the queue.
+ */
+QUEUE_INLINE uint32_t queue_count(Queue *queue) {
+	return ATOMIC_LOAD_ACQUIRE(&queue->tail) - ATOMIC_LOAD_ACQUIRE(&queue->head);
+}
 
 /*! \brief Checks if the supplied queue is full.
  *  \param queue Queue structure to operate on.
  *  \return True (1) if the queue is full, false (0) otherwise.
  */
-int queue_is_full(Queue *queue);
+QUEUE_INLINE int queue_is_full(Queue *queue) {
+	return ATOMIC_LOAD_ACQUIRE(&queue->tail) - ATOMIC_LOAD_ACQUIRE(&queue->head) > queue->mask;
+}
 
 /*! \brief Checks if the supplied queue is empty.
  *  \param queue Queue structure to operate on.
  *  \return True (1) if the queue is empty, false (0) otherwise.
  */
-int queue_is_empty(Queue *queue);
+QUEUE_INLINE int queue_is_empty(Queue *queue) {
+	return ATOMIC_LOAD_ACQUIRE(&queue->tail) == ATOMIC_LOAD_ACQUIRE(&queue->head);
+}
 
-#endif // QUEUE_H
+#ifdef QUEUE_STATS
+/*! \brief Takes a snapshot of the occupancy counters of a queue.
+ *  Only available when QUEUE_STATS is defined.
+ *  \param queue Queue structure to operate on.
+ *  \param stats Where the counters are copied to.
+ */
+void queue_get_stats(Queue *queue, QueueStats *stats);
 
-// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************   
+/*! \brief Zeroes the occupancy counters of a queue.
+ *  Only available when QUEUE_STATS is defined.
+ *  \param queue Queue structure to operate on.
+ */
+void queue_reset_stats(Queue *queue);
+#endif
+
+#endif // QUEUE_H
 
+// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************
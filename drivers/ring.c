@@ -0,0 +1,66 @@
+#include "ring.h"
+#include <string.h>
+
+static uint8_t *ring_slot(Ring *ring, uint32_t index) {
+	return &ring->data[(index & ring->mask) * ring->elem_size];
+}
+
+int ring_init(Ring *ring, void *storage, uint32_t elem_size, uint32_t size) {
+	if (storage == 0 || elem_size == 0 || size == 0 || (size & (size - 1)) != 0) {
+		return 0;
+	}
+
+	ring->data = (uint8_t*)storage;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->mask = size - 1;
+	ring->elem_size = elem_size;
+	return 1;
+}
+
+int ring_push(Ring *ring, const void *item) {
+	uint32_t tail = ring->tail;
+
+	if (tail - ATOMIC_LOAD_ACQUIRE(&ring->head) > ring->mask) {
+		return 0;
+	}
+	memcpy(ring_slot(ring, tail), item, ring->elem_size);
+	ATOMIC_STORE_RELEASE(&ring->tail, tail + 1);
+	return 1;
+}
+
+int ring_pop(Ring *ring, void *item) {
+	uint32_t head = ring->head;
+
+	if (ATOMIC_LOAD_ACQUIRE(&ring->tail) == head) {
+		return 0;
+	}
+	memcpy(item, ring_slot(ring, head), ring->elem_size);
+	ATOMIC_STORE_RELEASE(&ring->head, head + 1);
+	return 1;
+}
+
+void *ring_peek(Ring *ring) {
+	uint32_t head = ring->head;
+
+	if (ATOMIC_LOAD_ACQUIRE(&ring->tail) == head) {
+		return 0;
+	}
+	return ring_slot(ring, head);
+}
+
+void ring_skip(Ring *ring) {
+	ATOMIC_STORE_RELEASE(&ring->head, ring->head + 1);
+}
+
+void ring_truncate(Ring *ring, uint32_t keep) {
+	ATOMIC_STORE_RELEASE(&ring->tail, ring->head + keep);
+}
+
+int ring_is_full(Ring *ring) {
+	return ATOMIC_LOAD_ACQUIRE(&ring->tail) - ATOMIC_LOAD_ACQUIRE(&ring->head) > ring->mask;
+}
+
+int ring_is_empty(Ring *ring) {
+	return ATOMIC_LOAD_ACQUIRE(&ring->tail) == ATOMIC_LOAD_ACQUIRE(&ring->head);
+}
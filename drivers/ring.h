@@ -0,0 +1,103 @@
+/*!
+ * \file      ring.h
+ * \brief     Implements a FIFO of fixed-size records.
+ *
+ * Works like the byte queue in queue.h, but each element is a
+ * record of \a elem_size bytes (for example a struct describing an
+ * event), so a producer hands over a whole record with one copy.
+ * The same single-producer / single-consumer rules apply: only the
+ * producer may call ring_push() and ring_is_full(); only the
+ * consumer may call ring_pop(), ring_peek() and ring_skip().
+ */
+#ifndef RING_H
+#define RING_H
+#include <stdint.h>
+#include "atomic.h"
+
+/*! This structure encapsulates the ring data structure.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by ring.h.
+ */
+typedef struct {
+	uint8_t* data;      //!< Array of records.
+	uint32_t head;      //!< Count of records removed, written only by the consumer.
+	uint32_t tail;      //!< Count of records added, written only by the producer.
+	uint32_t mask;      //!< Number of records in the array minus one.
+	uint32_t elem_size; //!< Size of one record in bytes.
+} Ring;
+
+/*! \brief Defines a ring called \a name holding up to \a size
+ *         records of type \a type in a static array.
+ *  The ring is ready to use without calling ring_init(). A
+ *  \a size that is not a power of two is rejected at compile time.
+ *  \param name  Name of the Ring variable to define.
+ *  \param type  Type of one record.
+ *  \param size  Amount of records the ring can hold.
+ */
+#define RING_DEFINE(name, type, size) \
+	POWER_OF_TWO_CHECK(name, size); \
+	static type name##_data[(size)]; \
+	static Ring name = { (uint8_t*)name##_data, 0, 0, (size) - 1, sizeof(type) }
+
+/*! \brief Initialises the supplied ring to use a caller-provided array.
+ *  \param ring      Ring structure to operate on.
+ *  \param storage   Array of at least \a size records.
+ *  \param elem_size Size of one record in bytes.
+ *  \param size      Amount of records the ring can hold. Must be a
+ *                   power of two.
+ *  \return True (1) if the operation is successful, false (0)
+ *          otherwise.
+ */
+int ring_init(Ring *ring, void *storage, uint32_t elem_size, uint32_t size);
+
+/*! \brief Copies a record to the back of the ring.
+ *  \param ring  Ring structure to operate on.
+ *  \param item  Record to add.
+ *  \return True (1) if the operation is successful (i.e. the
+ *          ring isn't full), false (0) otherwise.
+ */
+int ring_push(Ring *ring, const void *item);
+
+/*! \brief Copies out and removes the record at the front of the ring.
+ *  \param ring  Ring structure to operate on.
+ *  \param item  Where the record should be stored, if successful.
+ *  \return True (1) if the operation is successful (i.e. the
+ *          ring isn't empty), false (0) otherwise.
+ */
+int ring_pop(Ring *ring, void *item);
+
+/*! \brief Returns the record at the front of the ring in place.
+ *  The record stays in the ring until ring_skip() is called.
+ *  \param ring  Ring structure to operate on.
+ *  \return Pointer to the oldest record, or 0 if the ring is empty.
+ */
+void *ring_peek(Ring *ring);
+
+/*! \brief Removes the record at the front of the ring without
+ *         copying it out.
+ *  Must only follow a ring_peek() that returned a record.
+ *  \param ring  Ring structure to operate on.
+ */
+void ring_skip(Ring *ring);
+
+/*! \brief Discards the newest records, keeping the oldest \a keep.
+ *  Called by the producer to take back records it pushed, while the
+ *  consumer is not running (e.g. its interrupt is masked).
+ *  \param ring  Ring structure to operate on.
+ *  \param keep  Number of records to keep; no more than are queued.
+ */
+void ring_truncate(Ring *ring, uint32_t keep);
+
+/*! \brief Checks if the supplied ring is full.
+ *  \param ring  Ring structure to operate on.
+ *  \return True (1) if the ring is full, false (0) otherwise.
+ */
+int ring_is_full(Ring *ring);
+
+/*! \brief Checks if the supplied ring is empty.
+ *  \param ring  Ring structure to operate on.
+ *  \return True (1) if the ring is empty, false (0) otherwise.
+ */
+int ring_is_empty(Ring *ring);
+
+#endif // RING_H
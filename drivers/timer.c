@@ -1,5 +1,6 @@
 #include "platform.h"
 #include "timer.h"
+#include "STM32F4xx_RCC.h"
 
 uint32_t timer_period;
 
@@ -42,6 +43,30 @@ void timer_set_callback(void (*callback)(void)) {
 
 }
 
+const volatile uint32_t *timer_ms_clock_init(void) {
+	RCC_ClocksTypeDef clocks;
+	uint32_t timer_clock;
+
+	// The APB1 timers run at twice PCLK1 whenever APB1 is divided down.
+	RCC_GetClocksFreq(&clocks);
+	timer_clock = clocks.PCLK1_Frequency;
+	if (clocks.PCLK1_Frequency != clocks.HCLK_Frequency) {
+		timer_clock *= 2;
+	}
+	if (timer_clock / 1000 > 0x10000) {
+		return 0;
+	}
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM5, ENABLE);
+	TIM5->CR1 = 0;
+	TIM5->PSC = timer_clock / 1000 - 1;
+	TIM5->ARR = 0xFFFFFFFF;
+	TIM5->CNT = 0;
+	TIM5->EGR = TIM_EGR_UG; // Load the prescaler now, not at the first overflow
+	TIM5->CR1 = TIM_CR1_CEN;
+	return &TIM5->CNT;
+}
+
 void SysTick_Handler(void)
 {
 	timer_callback();
@@ -26,6 +26,15 @@ void timer_enable(void);
 /*! \brief Disables the timer. */
 void timer_disable(void);
 
+/*! \brief Starts TIM5 counting milliseconds, independently of the tick
+ *         above, which the application may stop.
+ *  The 32-bit count keeps running while the core sleeps and wraps after
+ *  about 49 days. The timer clock is divided down with the 16-bit
+ *  prescaler, so it must be at most 65.536 MHz.
+ *  \return The counter, or 0 if the timer clock is too fast.
+ */
+const volatile uint32_t *timer_ms_clock_init(void);
+
 #endif // TIMER_H
 
 // *******************************ARM University Program Copyright  ARM Ltd 2016*************************************   
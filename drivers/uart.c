@@ -3,98 +3,954 @@
 #include "STM32F4xx_RCC.h"
 #include "STM32F4xx_USART.h"
 #include "STM32F4xx_GPIO.h"
+#include "queue.h"
+#include "ring.h"
+#include <stdarg.h>
+#include <string.h>
 
-static void (*UART_callback)(uint8_t);
+POWER_OF_TWO_CHECK(uart_tx_buffer, UART_TX_BUFFER_SIZE);
+POWER_OF_TWO_CHECK(uart_tx_segments, UART_TX_SEGMENTS);
 
-void uart_init(uint32_t baud) {
+// Everything that differs between the USART instances.
+struct UartPortConfig {
+	USART_TypeDef *usart;
+	IRQn_Type irq;
+	int on_apb2;                   // Clocked from PCLK2 rather than PCLK1.
+	uint32_t clock;                // RCC_APBxPeriph_USARTx
+	GPIO_TypeDef *gpio;            // Port of all the pins below.
+	uint32_t gpio_clock;           // RCC_AHB1Periph_GPIOx
+	uint16_t tx_pin, rx_pin;       // GPIO_Pin_x
+	uint8_t tx_source, rx_source;  // GPIO_PinSourcex
+	uint8_t af;                    // GPIO_AF_USARTx
+	uint16_t cts_pin, rts_pin;     // Zero if the port has no flow control pins.
+	uint8_t cts_source;
+	DMA_TypeDef *dma;
+	uint32_t dma_clock;            // RCC_AHB1Periph_DMAx
+	uint32_t dma_channel;          // CHSEL bits, the same for both streams.
+	DMA_Stream_TypeDef *tx_stream;
+	IRQn_Type tx_stream_irq;
+	uint8_t tx_stream_index;
+	DMA_Stream_TypeDef *rx_stream;
+	IRQn_Type rx_stream_irq;
+	uint8_t rx_stream_index;
+};
+
+static const struct UartPortConfig uart_ports[UART_PORT_COUNT] = {
+	[UART_PORT_1] = {
+		.usart = USART1, .irq = USART1_IRQn,
+		.on_apb2 = 1, .clock = RCC_APB2Periph_USART1,
+		.gpio = GPIOA, .gpio_clock = RCC_AHB1Periph_GPIOA,
+		.tx_pin = GPIO_Pin_9, .rx_pin = GPIO_Pin_10,
+		.tx_source = GPIO_PinSource9, .rx_source = GPIO_PinSource10,
+		.af = GPIO_AF_USART1,
+		.cts_pin = GPIO_Pin_11, .rts_pin = GPIO_Pin_12, .cts_source = GPIO_PinSource11,
+		.dma = DMA2, .dma_clock = RCC_AHB1Periph_DMA2, .dma_channel = DMA_SxCR_CHSEL_2,
+		.tx_stream = DMA2_Stream7, .tx_stream_irq = DMA2_Stream7_IRQn, .tx_stream_index = 7,
+		.rx_stream = DMA2_Stream2, .rx_stream_irq = DMA2_Stream2_IRQn, .rx_stream_index = 2,
+	},
+	[UART_PORT_2] = {
+		.usart = USART2, .irq = USART2_IRQn,
+		.on_apb2 = 0, .clock = RCC_APB1Periph_USART2,
+		.gpio = GPIOA, .gpio_clock = RCC_AHB1Periph_GPIOA,
+		.tx_pin = GPIO_Pin_2, .rx_pin = GPIO_Pin_3,
+		.tx_source = GPIO_PinSource2, .rx_source = GPIO_PinSource3,
+		.af = GPIO_AF_USART2,
+		.cts_pin = GPIO_Pin_0, .rts_pin = GPIO_Pin_1, .cts_source = GPIO_PinSource0,
+		.dma = DMA1, .dma_clock = RCC_AHB1Periph_DMA1, .dma_channel = DMA_SxCR_CHSEL_2,
+		.tx_stream = DMA1_Stream6, .tx_stream_irq = DMA1_Stream6_IRQn, .tx_stream_index = 6,
+		.rx_stream = DMA1_Stream5, .rx_stream_irq = DMA1_Stream5_IRQn, .rx_stream_index = 5,
+	},
+	[UART_PORT_6] = {
+		// USART6's CTS/RTS share PA11/PA12 with USART1, so it goes without.
+		.usart = USART6, .irq = USART6_IRQn,
+		.on_apb2 = 1, .clock = RCC_APB2Periph_USART6,
+		.gpio = GPIOC, .gpio_clock = RCC_AHB1Periph_GPIOC,
+		.tx_pin = GPIO_Pin_6, .rx_pin = GPIO_Pin_7,
+		.tx_source = GPIO_PinSource6, .rx_source = GPIO_PinSource7,
+		.af = GPIO_AF_USART6,
+		.cts_pin = 0, .rts_pin = 0, .cts_source = 0,
+		.dma = DMA2, .dma_clock = RCC_AHB1Periph_DMA2, .dma_channel = DMA_SxCR_CHSEL_2 | DMA_SxCR_CHSEL_0,
+		.tx_stream = DMA2_Stream6, .tx_stream_irq = DMA2_Stream6_IRQn, .tx_stream_index = 6,
+		.rx_stream = DMA2_Stream1, .rx_stream_irq = DMA2_Stream1_IRQn, .rx_stream_index = 1,
+	},
+};
+
+// The Uart driving each port, for the interrupt handlers.
+static Uart *uart_instances[UART_PORT_COUNT];
+
+// Interrupt flags of one DMA stream, as they appear for stream 0.
+#define UART_DMA_FLAGS (DMA_LISR_FEIF0 | DMA_LISR_DMEIF0 | DMA_LISR_TEIF0 | DMA_LISR_HTIF0 | DMA_LISR_TCIF0)
+
+// Position of each stream's flags within LISR/HISR (streams 0-3 and 4-7).
+static const uint8_t uart_dma_flag_shift[4] = { 0, 6, 16, 22 };
+
+static uint32_t uart_dma_flags(DMA_TypeDef *dma, uint8_t stream) {
+	uint32_t isr = stream < 4 ? dma->LISR : dma->HISR;
+	return (isr >> uart_dma_flag_shift[stream & 3]) & UART_DMA_FLAGS;
+}
+
+static void uart_dma_clear(DMA_TypeDef *dma, uint8_t stream, uint32_t flags) {
+	flags <<= uart_dma_flag_shift[stream & 3];
+	if (stream < 4) {
+		dma->LIFCR = flags;
+	} else {
+		dma->HIFCR = flags;
+	}
+}
+
+static uint32_t uart_tx_lock(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static void uart_tx_unlock(uint32_t primask) {
+	__set_PRIMASK(primask);
+}
+
+// Policy of each channel until uart_set_tx_policy() changes it.
+static const UartTxPolicy uart_default_tx_policy[UART_CHANNEL_COUNT] = {
+	[UART_CHANNEL_ECHO] = UART_TX_DROP,
+	[UART_CHANNEL_STATUS] = UART_TX_BLOCK,
+	[UART_CHANNEL_VERBOSE] = UART_TX_COALESCE,
+};
+
+// Finds the next run of bytes a channel has to send: the rest of its
+// oldest segment once everything copied before it has gone, otherwise
+// the contiguous part of its queue up to the next segment.
+static uint32_t uart_tx_channel_block(UartTxChannel *channel, const uint8_t **block, int *is_segment) {
+	UartTxSegment *segment = ring_peek(&channel->segments);
+	uint32_t length = queue_peek_contiguous(&channel->queue, block);
+	uint32_t before;
+
+	*is_segment = 0;
+	if (segment == 0) {
+		return length;
+	}
+	before = segment->position - channel->queue.head;
+	if (before == 0) {
+		*is_segment = 1;
+		*block = segment->data + channel->segment_offset;
+		return segment->length - channel->segment_offset;
+	}
+	return length < before ? length : before;
+}
+
+// Picks up to UART_TX_BLOCK_LIMIT bytes from the highest priority
+// channel with anything waiting.
+static uint32_t uart_tx_next_block(Uart *uart, const uint8_t **block) {
+	uint32_t length;
+	int i;
+
+	for (i = 0; i < UART_CHANNEL_COUNT; i++) {
+		length = uart_tx_channel_block(&uart->tx[i], block, &uart->tx_block_is_segment);
+		if (length > 0) {
+			uart->tx_block_channel = &uart->tx[i];
+			return length < UART_TX_BLOCK_LIMIT ? length : UART_TX_BLOCK_LIMIT;
+		}
+	}
+	return 0;
+}
+
+// Releases \a length bytes of the block returned by uart_tx_next_block().
+static void uart_tx_consume(Uart *uart, uint32_t length) {
+	UartTxChannel *channel = uart->tx_block_channel;
+
+	if (uart->tx_block_is_segment) {
+		UartTxSegment *segment = ring_peek(&channel->segments);
+
+		channel->segment_offset += length;
+		if (channel->segment_offset == segment->length) {
+			channel->segment_offset = 0;
+			ring_skip(&channel->segments);
+		}
+	} else {
+		queue_commit(&channel->queue, length);
+	}
+}
+
+static int uart_tx_pending(Uart *uart) {
+	int i;
+
+	for (i = 0; i < UART_CHANNEL_COUNT; i++) {
+		if (!queue_is_empty(&uart->tx[i].queue) || !ring_is_empty(&uart->tx[i].segments)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Throws away what \a channel has waiting, apart from a block DMA is
+// already sending. Must be called inside uart_tx_lock().
+static void uart_tx_discard(Uart *uart, UartTxChannel *channel) {
+	uint32_t keep_bytes = 0;
+	uint32_t keep_segments = 0;
+
+#if UART_TX_DMA
+	if (uart->tx_dma_length != 0 && uart->tx_block_channel == channel) {
+		if (uart->tx_block_is_segment) {
+			keep_segments = 1;
+		} else {
+			keep_bytes = uart->tx_dma_length;
+		}
+	}
+#else
+	(void)uart;
+#endif
+	if (keep_segments == 0) {
+		channel->segment_offset = 0;
+	}
+	queue_truncate(&channel->queue, keep_bytes);
+	ring_truncate(&channel->segments, keep_segments);
+}
+
+#if UART_TX_DMA
+// Starts a transfer of the next block if the stream is idle. Copied
+// bytes stay in the ring while DMA reads them and are committed on
+// transfer complete, so writers keep filling the rest of the ring in
+// the meantime; segments are read straight from where they live. Must
+// be called inside uart_tx_lock().
+static void uart_tx_dma_start(Uart *uart) {
+	const struct UartPortConfig *port = uart->port;
+	const uint8_t *block;
+
+	if (uart->tx_dma_length != 0) {
+		return;
+	}
+	uart->tx_dma_length = uart_tx_next_block(uart, &block);
+	if (uart->tx_dma_length == 0) {
+		return;
+	}
+	uart_dma_clear(port->dma, port->tx_stream_index, UART_DMA_FLAGS);
+	port->tx_stream->M0AR = (uint32_t)block;
+	port->tx_stream->NDTR = uart->tx_dma_length;
+	// DMA writes to DR do not clear TC, which uart_flush() relies on.
+	// Write TC alone as zero: the other flags ignore a one, whereas a
+	// read-modify-write would clear an RXNE, CTS or LBD set meanwhile.
+	port->usart->SR = (uint16_t)~USART_SR_TC;
+	SET_BIT(port->tx_stream->CR, DMA_SxCR_EN);
+}
+#endif
+
+// Makes sure something will drain the channels. Must be called inside
+// uart_tx_lock().
+static void uart_tx_kick(Uart *uart) {
+#if UART_TX_DMA
+	uart_tx_dma_start(uart);
+#else
+	SET_BIT(uart->port->usart->CR1, USART_CR1_TXEIE);
+#endif
+}
+
+static void uart_deliver_raw(Uart *uart, const uint8_t *data, uint32_t len) {
+	if (len == 0) {
+		return;
+	}
+	if (uart->rx_chunk_callback) {
+		uart->rx_chunk_callback(data, len);
+	} else if (uart->rx_callback) {
+		while (len-- > 0) {
+			uart->rx_callback(*data++);
+		}
+	}
+}
+
+// Applies one typed character to the line being collected.
+static void uart_line_edit(Uart *uart, uint8_t c) {
+	uint8_t fill = uart->line_fill;
+
+	if (fill > 1) {
+		return; // Both buffers held, nowhere to put it
+	}
+	if (c == '\b' || c == 0x7F) {
+		if (uart->line_length[fill] > 0) {
+			uart->line_length[fill]--;
+			uart_channel_print_literal(uart, UART_CHANNEL_ECHO, "\b \b");
+		}
+	} else if (c >= 0x20 && c < 0x7F) {
+		if (uart->line_length[fill] < UART_LINE_SIZE - 1) {
+			uart->line_buffer[fill][uart->line_length[fill]++] = c;
+			uart_channel_write(uart, UART_CHANNEL_ECHO, &c, 1);
+		}
+	} else if (c == '\r') {
+		uart_channel_print_literal(uart, UART_CHANNEL_ECHO, "\r\n");
+		uart->line_buffer[fill][uart->line_length[fill]] = '\0';
+		if (uart->line_held == 0) {
+			uart->line_oldest = fill;
+		}
+		uart->line_held |= 1 << fill;
+		// Carry on in the other buffer if the application has finished with it.
+		uart->line_fill = (uart->line_held & (1 << (fill ^ 1))) ? 2 : fill ^ 1;
+		if (uart->line_fill <= 1) {
+			uart->line_length[uart->line_fill] = 0;
+		}
+		uart->line_callback(uart->line_buffer[fill], uart->line_length[fill]);
+	}
+}
+
+static void uart_deliver(Uart *uart, const uint8_t *data, uint32_t len) {
+	if (uart->line_callback && !uart->line_suspended) {
+		uint32_t i;
+
+		for (i = 0; i < len && data[i] != 0; i++) {
+			uart_line_edit(uart, data[i]);
+		}
+		uart_deliver_raw(uart, data, i);
+		if (i == len) {
+			return;
+		}
+		// A zero byte starts binary data: pass it and the rest on unedited.
+		uart->line_suspended = 1;
+		data += i;
+		len -= i;
+	}
+	uart_deliver_raw(uart, data, len);
+}
+
+#if UART_RX_DMA
+// Hands everything DMA has written since the last call to the
+// application, in two pieces if it wrapped round the buffer. Called
+// from the line-idle and the half/full transfer interrupts, which share
+// a priority and so never preempt each other.
+static void uart_rx_dma_poll(Uart *uart) {
+	uint32_t write = UART_RX_DMA_BUFFER_SIZE - uart->port->rx_stream->NDTR;
+
+	if (write == UART_RX_DMA_BUFFER_SIZE) {
+		write = 0;
+	}
+	if (write == uart->rx_dma_read) {
+		return;
+	}
+	if (write < uart->rx_dma_read) {
+		uart_deliver(uart, &uart->rx_dma_buffer[uart->rx_dma_read], UART_RX_DMA_BUFFER_SIZE - uart->rx_dma_read);
+		uart->rx_dma_read = 0;
+	}
+	if (write > uart->rx_dma_read) {
+		uart_deliver(uart, &uart->rx_dma_buffer[uart->rx_dma_read], write - uart->rx_dma_read);
+	}
+	uart->rx_dma_read = write;
+}
+#endif
+
+// The UartError values are the matching USART_SR bits.
+static void uart_count_errors(Uart *uart, uint32_t errors) {
+	if (errors & UART_ERROR_PARITY) {
+		uart->error_counts.parity++;
+	}
+	if (errors & UART_ERROR_FRAMING) {
+		uart->error_counts.framing++;
+	}
+	if (errors & UART_ERROR_NOISE) {
+		uart->error_counts.noise++;
+	}
+	if (errors & UART_ERROR_OVERRUN) {
+		uart->error_counts.overrun++;
+	}
+	if (uart->error_callback) {
+		uart->error_callback(errors);
+	}
+}
+
+// Starts delivering received data to whichever callback is set.
+static void uart_rx_start(Uart *uart) {
+	const struct UartPortConfig *port = uart->port;
+
+#if UART_RX_DMA
+	if (!READ_BIT(port->rx_stream->CR, DMA_SxCR_EN)) {
+		// Peripheral to memory, circular, interrupting at each half of
+		// the buffer.
+		RCC_AHB1PeriphClockCmd(port->dma_clock, ENABLE);
+		uart->rx_dma_read = 0;
+		uart_dma_clear(port->dma, port->rx_stream_index, UART_DMA_FLAGS);
+		port->rx_stream->PAR = (uint32_t)&port->usart->DR;
+		port->rx_stream->M0AR = (uint32_t)uart->rx_dma_buffer;
+		port->rx_stream->NDTR = UART_RX_DMA_BUFFER_SIZE;
+		port->rx_stream->FCR = 0;
+		port->rx_stream->CR = port->dma_channel | DMA_SxCR_MINC | DMA_SxCR_CIRC |
+		                      DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+		SET_BIT(port->usart->CR3, USART_CR3_DMAR);
+		SET_BIT(port->rx_stream->CR, DMA_SxCR_EN);
+	}
+	// A gap after the last byte of a burst flushes it out early.
+	SET_BIT(port->usart->CR1, USART_CR1_IDLEIE);
+	NVIC_SetPriority(port->rx_stream_irq,0);
+	NVIC_EnableIRQ(port->rx_stream_irq);
+#else
+	SET_BIT(port->usart->CR1, USART_CR1_RXNEIE);
+#endif
+	// Parity errors interrupt through PEIE; framing, noise and overrun
+	// through EIE while DMA is receiving and through RXNEIE otherwise.
+	SET_BIT(port->usart->CR1, USART_CR1_PEIE);
+	SET_BIT(port->usart->CR3, USART_CR3_EIE);
+	NVIC_SetPriority(port->irq,0);
+	NVIC_ClearPendingIRQ(port->irq);
+	NVIC_EnableIRQ(port->irq);
+}
+
+// True if the transmit interrupt cannot run until we return.
+static int uart_tx_cannot_wait(void) {
+	return __get_IPSR() != 0 || __get_PRIMASK() != 0;
+}
+
+void uart_write(Uart *uart, const void *buf, size_t len) {
+	uart_channel_write(uart, UART_CHANNEL_STATUS, buf, len);
+}
+
+void uart_channel_write(Uart *uart, UartChannel channel, const void *buf, size_t len) {
+	UartTxChannel *tx = &uart->tx[channel];
+	const uint8_t *data = (const uint8_t *)buf;
+	UartTxPolicy policy = tx->policy;
+	uint32_t primask;
+	uint32_t queued;
+	int fits;
+
+	if (policy == UART_TX_BLOCK && uart_tx_cannot_wait()) {
+		policy = UART_TX_TRUNCATE;
+	}
+
+	for (;;) {
+		primask = uart_tx_lock();
+		fits = len <= UART_TX_BUFFER_SIZE - queue_count(&tx->queue);
+		if (!fits && policy == UART_TX_DROP) {
+			queued = 0;
+		} else {
+			if (!fits && policy == UART_TX_COALESCE) {
+				uart_tx_discard(uart, tx);
+			}
+			queued = queue_enqueue_n(&tx->queue, data, len);
+		}
+		if (queued > 0) {
+			uart_tx_kick(uart);
+		}
+		uart_tx_unlock(primask);
+
+		data += queued;
+		len -= queued;
+		if (len == 0 || policy != UART_TX_BLOCK) {
+			return;
+		}
+		// Ring full, wait for the interrupt to free some room.
+		while (queue_is_full(&tx->queue)) {
+		}
+	}
+}
+
+void uart_write_const(Uart *uart, const void *data, size_t len) {
+	uart_channel_write_const(uart, UART_CHANNEL_STATUS, data, len);
+}
+
+void uart_channel_write_const(Uart *uart, UartChannel channel, const void *data, size_t len) {
+	UartTxChannel *tx = &uart->tx[channel];
+	UartTxSegment segment;
+	uint32_t primask;
+	int queued;
+
+	if (len == 0) {
+		return;
+	}
+	segment.data = (const uint8_t *)data;
+	segment.length = len;
+
+	primask = uart_tx_lock();
+	segment.position = tx->queue.tail;
+	queued = ring_push(&tx->segments, &segment);
+	if (queued) {
+		uart_tx_kick(uart);
+	}
+	uart_tx_unlock(primask);
+
+	if (!queued) {
+		// Out of segments, so fall back to copying under the usual policy.
+		uart_channel_write(uart, channel, data, len);
+	}
+}
+
+int uart_baud_calc(uint32_t pclk, uint32_t baud, UartBaud *setting) {
+	// In both oversampling modes the BRR resolution is one PCLK cycle per
+	// bit, so the best divider is pclk / baud rounded to nearest. With 16x
+	// oversampling it must be at least 16; 8x halves that minimum.
+	uint32_t divider = baud == 0 ? 0xFFFF : (pclk + baud / 2) / baud;
+	int exact = 1;
+
+	if (divider < 8) {
+		divider = 8;
+		exact = 0;
+	} else if (divider > 0xFFFF) {
+		divider = 0xFFFF;
+		exact = 0;
+	}
+	setting->requested = baud;
+	setting->actual = (pclk + divider / 2) / divider;
+	setting->error_ppm = baud == 0 ? 0 :
+		(int32_t)(((int64_t)setting->actual - baud) * 1000000 / baud);
+	setting->over8 = divider < 16;
+	if (setting->over8) {
+		// The fraction field is three bits; bit 3 must be kept clear.
+		setting->brr = (uint16_t)(((divider >> 3) << 4) | (divider & 0x7));
+	} else {
+		setting->brr = (uint16_t)divider;
+	}
+	return exact;
+}
+
+void uart_get_baud(Uart *uart, UartBaud *setting) {
+	memcpy(setting, &uart->baud, sizeof(UartBaud));
+}
+
+void uart_init(Uart *uart, UartPort port_id, uint32_t baud) {
+	const struct UartPortConfig *port = &uart_ports[port_id];
 	GPIO_InitTypeDef GPIO_InitStructure;
 	USART_InitTypeDef USART_InitStructure;
-	
+	RCC_ClocksTypeDef clocks;
+	int i;
+
+	memset(uart, 0, sizeof(Uart));
+	uart->port = port;
+	for (i = 0; i < UART_CHANNEL_COUNT; i++) {
+		UartTxChannel *tx = &uart->tx[i];
+
+		tx->policy = uart_default_tx_policy[i];
+		queue_init_static(&tx->queue, tx->data, UART_TX_BUFFER_SIZE);
+		ring_init(&tx->segments, tx->segment_data, sizeof(UartTxSegment), UART_TX_SEGMENTS);
+	}
+	uart_instances[port_id] = uart;
+
 	/* --------------------------- System Clocks Configuration -----------------*/
-  /* USART2 clock enable */
-  RCC_APB1PeriphClockCmd(RCC_APB1Periph_USART2, ENABLE);
-  /* GPIOA clock enable */
-  RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOA, ENABLE);
-	
+  /* USART clock enable */
+  if (port->on_apb2) {
+    RCC_APB2PeriphClockCmd(port->clock, ENABLE);
+  } else {
+    RCC_APB1PeriphClockCmd(port->clock, ENABLE);
+  }
+  /* GPIO clock enable */
+  RCC_AHB1PeriphClockCmd(port->gpio_clock, ENABLE);
+
   /*-------------------------- GPIO Configuration ----------------------------*/
-  GPIO_InitStructure.GPIO_Pin = GPIO_Pin_2 | GPIO_Pin_3; // PA.2 USART2_TX, PA.3 USART2_RX
+  GPIO_InitStructure.GPIO_Pin = port->tx_pin | port->rx_pin;
   GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
   GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
   GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
   GPIO_InitStructure.GPIO_Speed = GPIO_Speed_2MHz;
-  GPIO_Init(GPIOA, &GPIO_InitStructure);
+  GPIO_Init(port->gpio, &GPIO_InitStructure);
   /* Connect USART pins to AF */
-  GPIO_PinAFConfig(GPIOA, GPIO_PinSource2, GPIO_AF_USART2);
-  GPIO_PinAFConfig(GPIOA, GPIO_PinSource3, GPIO_AF_USART2);
-	
+  GPIO_PinAFConfig(port->gpio, port->tx_source, port->af);
+  GPIO_PinAFConfig(port->gpio, port->rx_source, port->af);
+#if UART_FLOW_CONTROL
+  if (port->cts_pin != 0) {
+    /* CTS, pulled down so that an unconnected line reads as clear to send */
+    GPIO_InitStructure.GPIO_Pin = port->cts_pin;
+    GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_DOWN;
+    GPIO_Init(port->gpio, &GPIO_InitStructure);
+    GPIO_PinAFConfig(port->gpio, port->cts_source, port->af);
+    /* RTS, a plain output driven by uart_rx_pause()/uart_rx_resume(); low is ready */
+    GPIO_ResetBits(port->gpio, port->rts_pin);
+    GPIO_InitStructure.GPIO_Pin = port->rts_pin;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_OUT;
+    GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+    GPIO_Init(port->gpio, &GPIO_InitStructure);
+  }
+#endif
+
   /* USARTx configuration ------------------------------------------------------*/
   /* USARTx configured as follow:
-        - BaudRate = 115200 baud
+        - BaudRate = baud
         - Word Length = 8 Bits
         - One Stop Bit
         - No parity
-        - Hardware flow control disabled (RTS and CTS signals)
+        - Hardware flow control on CTS only if UART_FLOW_CONTROL (RTS is software driven)
         - Receive and transmit enabled
   */
   USART_InitStructure.USART_BaudRate = baud;
   USART_InitStructure.USART_WordLength = USART_WordLength_8b;
   USART_InitStructure.USART_StopBits = USART_StopBits_1;
   USART_InitStructure.USART_Parity = USART_Parity_No;
+#if UART_FLOW_CONTROL
+  USART_InitStructure.USART_HardwareFlowControl = port->cts_pin != 0 ? USART_HardwareFlowControl_CTS : USART_HardwareFlowControl_None;
+#else
   USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+#endif
   USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
-  USART_Init(USART2, &USART_InitStructure);
+  USART_Init(port->usart, &USART_InitStructure);
+
+	// USART_Init() only divides with 16x oversampling; replace its divider
+	// with one that can use 8x for rates close to PCLK / 16.
+	RCC_GetClocksFreq(&clocks);
+	uart_baud_calc(port->on_apb2 ? clocks.PCLK2_Frequency : clocks.PCLK1_Frequency, baud, &uart->baud);
+	if (uart->baud.over8) {
+		SET_BIT(port->usart->CR1, USART_CR1_OVER8);
+	} else {
+		CLEAR_BIT(port->usart->CR1, USART_CR1_OVER8);
+	}
+	port->usart->BRR = uart->baud.brr;
+
+#if UART_TX_DMA
+	// Memory to peripheral, byte wide, incrementing the memory address,
+	// interrupt on completion.
+	RCC_AHB1PeriphClockCmd(port->dma_clock, ENABLE);
+	CLEAR_BIT(port->tx_stream->CR, DMA_SxCR_EN);
+	while (READ_BIT(port->tx_stream->CR, DMA_SxCR_EN)) {
+	}
+	port->tx_stream->PAR = (uint32_t)&port->usart->DR;
+	port->tx_stream->CR = port->dma_channel | DMA_SxCR_DIR_0 |
+	                      DMA_SxCR_MINC | DMA_SxCR_TCIE;
+	port->tx_stream->FCR = 0;
+	SET_BIT(port->usart->CR3, USART_CR3_DMAT);
+#endif
 }
 
-void uart_enable(void) {
-	USART_Cmd(USART2, ENABLE);
+void uart_enable(Uart *uart) {
+	const struct UartPortConfig *port = uart->port;
+
+	USART_Cmd(port->usart, ENABLE);
+
+	// The transmit path is interrupt driven even if nothing is received.
+	NVIC_SetPriority(port->irq,0);
+	NVIC_EnableIRQ(port->irq);
+#if UART_TX_DMA
+	NVIC_SetPriority(port->tx_stream_irq,0);
+	NVIC_EnableIRQ(port->tx_stream_irq);
+#endif
 }
 
-void uart_print(char *string) {
-	while(*string) {
-    uart_tx(*string++);
-  }
+void uart_print(Uart *uart, const char *string) {
+	uart_write(uart, string, strlen(string));
+}
+
+// Writes a number in base 10 or 16, most significant digit first.
+static int uart_write_number(Uart *uart, UartChannel channel, unsigned long magnitude, unsigned int base, int negative) {
+	char digits[sizeof(unsigned long) * 3 + 1]; // Decimal digits plus a sign
+	char *start = digits + sizeof(digits);
+	int length;
+
+	do {
+		*--start = "0123456789abcdef"[magnitude % base];
+		magnitude /= base;
+	} while (magnitude != 0);
+	if (negative) {
+		*--start = '-';
+	}
+	length = digits + sizeof(digits) - start;
+	uart_channel_write(uart, channel, start, length);
+	return length;
+}
+
+int uart_channel_vprintf(Uart *uart, UartChannel channel, const char *format, va_list args) {
+	const char *run = format;
+	int count = 0;
+	int is_long;
+
+	while (*format != '\0') {
+		if (*format != '%') {
+			format++;
+			continue;
+		}
+		// Send the literal text before the conversion in one piece.
+		if (format > run) {
+			uart_channel_write(uart, channel, run, format - run);
+			count += format - run;
+		}
+		format++;
+		is_long = (*format == 'l');
+		if (is_long) {
+			format++;
+		}
+		switch (*format) {
+		case 'c': {
+			char c = (char)va_arg(args, int);
+			uart_channel_write(uart, channel, &c, 1);
+			count++;
+			break;
+		}
+		case 'd': {
+			long value = is_long ? va_arg(args, long) : va_arg(args, int);
+			count += value < 0 ? uart_write_number(uart, channel, 0UL - (unsigned long)value, 10, 1)
+			                   : uart_write_number(uart, channel, (unsigned long)value, 10, 0);
+			break;
+		}
+		case 'u':
+		case 'x': {
+			unsigned long value = is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+			count += uart_write_number(uart, channel, value, *format == 'x' ? 16 : 10, 0);
+			break;
+		}
+		case 's': {
+			const char *string = va_arg(args, const char *);
+			size_t length = strlen(string);
+			uart_channel_write(uart, channel, string, length);
+			count += length;
+			break;
+		}
+		case '\0':
+			// A lone '%' at the end is dropped.
+			format--;
+			break;
+		default:
+			// '%%' and anything unsupported are sent as they are.
+			uart_channel_write(uart, channel, format, 1);
+			count++;
+			break;
+		}
+		format++;
+		run = format;
+	}
+	if (format > run) {
+		uart_channel_write(uart, channel, run, format - run);
+		count += format - run;
+	}
+	return count;
 }
 
-void uart_set_rx_callback(void (*callback)(uint8_t)) {
-	// Set up and enable the interrupt.
-	
-	// The callback function should be stored in an internal
-	// static function pointer.
-	
-	// Whenever a character is received by the UART peripheral,
-	// the callback function should be executed with the
-	// parameter equalling the received character.
-	
-	UART_callback = callback;
-	USART2->CR1|=USART_CR1_RXNEIE;
-	
-	//Enable the USART interrupt
+int uart_printf(Uart *uart, const char *format, ...) {
+	va_list args;
+	int count;
+
+	va_start(args, format);
+	count = uart_channel_vprintf(uart, UART_CHANNEL_STATUS, format, args);
+	va_end(args);
+	return count;
+}
+
+int uart_channel_printf(Uart *uart, UartChannel channel, const char *format, ...) {
+	va_list args;
+	int count;
+
+	va_start(args, format);
+	count = uart_channel_vprintf(uart, channel, format, args);
+	va_end(args);
+	return count;
+}
+
+void uart_set_tx_policy(Uart *uart, UartChannel channel, UartTxPolicy policy) {
+	uart->tx[channel].policy = policy;
+}
+
+void uart_flush(Uart *uart) {
+	while (uart_tx_pending(uart)) {
+	}
+	while (USART_GetFlagStatus(uart->port->usart, USART_FLAG_TC) == RESET) {
+	}
+}
+
+void uart_set_rx_callback(Uart *uart, void (*callback)(uint8_t)) {
+	uart->rx_callback = callback;
+	uart_rx_start(uart);
 	__enable_irq();
-	NVIC_SetPriority(USART2_IRQn,0);
-	NVIC_ClearPendingIRQ(USART2_IRQn);
-	NVIC_EnableIRQ(USART2_IRQn);
 }
 
-void uart_tx(uint8_t c) {
-	while(USART_GetFlagStatus(USART2, USART_FLAG_TXE) == RESET) {
-	}		// Wait for Empty
-  USART_SendData(USART2, c); // Echo Char
+void uart_set_rx_chunk_callback(Uart *uart, void (*callback)(const uint8_t *data, uint32_t len)) {
+	uart->rx_chunk_callback = callback;
+	uart_rx_start(uart);
+	__enable_irq();
 }
 
-uint8_t uart_rx(void) {
+void uart_set_line_callback(Uart *uart, void (*callback)(const char *line, uint32_t len)) {
+	uart->line_fill = 0;
+	uart->line_length[0] = 0;
+	uart->line_held = 0;
+	uart->line_suspended = 0;
+	uart->line_callback = callback;
+	uart_rx_start(uart);
+	__enable_irq();
+}
+
+int uart_line_peek(Uart *uart, const char **line, uint32_t *len) {
+	uint8_t oldest = uart->line_oldest;
+
+	if ((uart->line_held & (1 << oldest)) == 0) {
+		return 0;
+	}
+	*line = uart->line_buffer[oldest];
+	*len = uart->line_length[oldest];
+	return 1;
+}
+
+void uart_line_release(Uart *uart) {
+	uint32_t primask = uart_tx_lock();
+	uint8_t oldest = uart->line_oldest;
+
+	if (uart->line_held & (1 << oldest)) {
+		uart->line_held &= ~(1 << oldest);
+		if (uart->line_fill > 1) {
+			// Typing was stalled; it continues in the freed buffer.
+			uart->line_fill = oldest;
+			uart->line_length[oldest] = 0;
+		}
+		uart->line_oldest = oldest ^ 1;
+	}
+	uart_tx_unlock(primask);
+}
+
+void uart_line_resume(Uart *uart) {
+	uart->line_suspended = 0;
+}
+
+int uart_line_is_active(Uart *uart) {
+	return uart->line_callback != 0 && !uart->line_suspended;
+}
+
+void uart_set_error_callback(Uart *uart, void (*callback)(uint32_t errors)) {
+	uart->error_callback = callback;
+}
+
+void uart_get_error_counts(Uart *uart, UartErrorCounts *counts) {
+	memcpy(counts, &uart->error_counts, sizeof(UartErrorCounts));
+}
+
+void uart_reset_error_counts(Uart *uart) {
+	memset(&uart->error_counts, 0, sizeof(UartErrorCounts));
+}
+
+void uart_rx_pause(Uart *uart) {
+#if UART_FLOW_CONTROL
+	if (uart->port->rts_pin != 0) {
+		GPIO_SetBits(uart->port->gpio, uart->port->rts_pin);
+	}
+#endif
+	uart->rx_paused = 1;
+}
+
+void uart_rx_resume(Uart *uart) {
+#if UART_FLOW_CONTROL
+	if (uart->port->rts_pin != 0) {
+		GPIO_ResetBits(uart->port->gpio, uart->port->rts_pin);
+	}
+#endif
+	uart->rx_paused = 0;
+}
+
+int uart_rx_is_paused(Uart *uart) {
+	return uart->rx_paused;
+}
+
+void uart_tx(Uart *uart, uint8_t c) {
+	uart_write(uart, &c, 1);
+}
+
+uint8_t uart_rx(Uart *uart) {
 	uint16_t Data;
-	while(USART_GetFlagStatus(USART2, USART_FLAG_RXNE) == RESET) {
+	while(USART_GetFlagStatus(uart->port->usart, USART_FLAG_RXNE) == RESET) {
 	}		// Wait for Char
-	Data = USART_ReceiveData(USART2); // Collect Char
+	Data = USART_ReceiveData(uart->port->usart); // Collect Char
 	return Data;
 }
 
-void USART2_IRQHandler(void){
-	NVIC_ClearPendingIRQ(USART2_IRQn);
-	if (READ_BIT(USART2->SR, USART_SR_RXNE)) {
-		// received a character
-		UART_callback(uart_rx());
+static void uart_irq(UartPort port_id) {
+	Uart *uart = uart_instances[port_id];
+	USART_TypeDef *usart = uart_ports[port_id].usart;
+	uint32_t sr = usart->SR;
+	uint32_t errors = sr & (USART_SR_PE | USART_SR_FE | USART_SR_NE | USART_SR_ORE);
+
+	NVIC_ClearPendingIRQ(uart_ports[port_id].irq);
+	if (uart == 0) {
+		return;
+	}
+	if (errors) {
+		uart_count_errors(uart, errors);
+	}
+#if UART_RX_DMA
+	if (errors || (READ_BIT(usart->CR1, USART_CR1_IDLEIE) && (sr & USART_SR_IDLE))) {
+		// The line went quiet or a byte was bad. IDLE and the error
+		// flags are all cleared by reading SR then DR; an overrun
+		// would otherwise keep interrupting.
+		(void)usart->DR;
+		uart_rx_dma_poll(uart);
+	}
+#else
+	if (READ_BIT(usart->CR1, USART_CR1_RXNEIE) && (sr & USART_SR_RXNE)) {
+		// received a character; reading DR also clears any error flags
+		uint8_t c = (uint8_t)USART_ReceiveData(usart);
+		uart_deliver(uart, &c, 1);
+	} else if (errors) {
+		(void)usart->DR;
+	}
+#endif
+	if (READ_BIT(usart->CR1, USART_CR1_TXEIE) && READ_BIT(usart->SR, USART_SR_TXE)) {
+		// ready for the next character. Under the lock, so that a
+		// writer in a higher priority handler can neither discard the
+		// character between picking and releasing it nor have its TXEIE
+		// undone.
+		const uint8_t *block;
+		uint32_t primask = uart_tx_lock();
+		if (uart_tx_next_block(uart, &block) > 0) {
+			USART_SendData(usart, *block);
+			uart_tx_consume(uart, 1);
+		} else {
+			CLEAR_BIT(usart->CR1, USART_CR1_TXEIE);
+		}
+		uart_tx_unlock(primask);
+	}
+}
+
+void USART1_IRQHandler(void) {
+	uart_irq(UART_PORT_1);
+}
+
+void USART2_IRQHandler(void) {
+	uart_irq(UART_PORT_2);
+}
+
+void USART6_IRQHandler(void) {
+	uart_irq(UART_PORT_6);
+}
+
+#if UART_RX_DMA
+static void uart_rx_dma_irq(UartPort port_id) {
+	const struct UartPortConfig *port = &uart_ports[port_id];
+	uint32_t flags = uart_dma_flags(port->dma, port->rx_stream_index) &
+	                 (DMA_LISR_HTIF0 | DMA_LISR_TCIF0);
+
+	if (flags) {
+		uart_dma_clear(port->dma, port->rx_stream_index, flags);
+		if (uart_instances[port_id] != 0) {
+			uart_rx_dma_poll(uart_instances[port_id]);
+		}
 	}
 }
 
-// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************   
+void DMA2_Stream2_IRQHandler(void) {
+	uart_rx_dma_irq(UART_PORT_1);
+}
+
+void DMA1_Stream5_IRQHandler(void) {
+	uart_rx_dma_irq(UART_PORT_2);
+}
+
+void DMA2_Stream1_IRQHandler(void) {
+	uart_rx_dma_irq(UART_PORT_6);
+}
+#endif
+
+#if UART_TX_DMA
+static void uart_tx_dma_irq(UartPort port_id) {
+	const struct UartPortConfig *port = &uart_ports[port_id];
+	Uart *uart = uart_instances[port_id];
+
+	if (uart_dma_flags(port->dma, port->tx_stream_index) & (DMA_LISR_TCIF0 | DMA_LISR_TEIF0)) {
+		// The previous region has been sent (or the transfer failed and
+		// is abandoned); release it and start on whatever was queued
+		// meanwhile.
+		uint32_t primask = uart_tx_lock();
+		uart_dma_clear(port->dma, port->tx_stream_index, DMA_LISR_TCIF0 | DMA_LISR_TEIF0);
+		if (uart != 0) {
+			uart_tx_consume(uart, uart->tx_dma_length);
+			uart->tx_dma_length = 0;
+			uart_tx_dma_start(uart);
+		}
+		uart_tx_unlock(primask);
+	}
+}
+
+void DMA2_Stream7_IRQHandler(void) {
+	uart_tx_dma_irq(UART_PORT_1);
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+	uart_tx_dma_irq(UART_PORT_2);
+}
+
+void DMA2_Stream6_IRQHandler(void) {
+	uart_tx_dma_irq(UART_PORT_6);
+}
+#endif
+
+// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************
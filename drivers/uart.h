@@ -2,44 +2,458 @@
  * \file      uart.h
  * \brief     Controller for a hardware UART module.
  * \copyright ARM University Program &copy; ARM Ltd 2014.
+ *
+ * USART1, USART2 and USART6 can be used at the same time. Each one is
+ * a Uart structure owned by the caller and passed to every function;
+ * it holds the instance's rings, callbacks and counters.
  */
 #ifndef UART_H
 #define UART_H
 #include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include "queue.h"
+#include "ring.h"
+
+/*! Size of the transmit ring of each channel in bytes. Must be a
+ *  power of two. */
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 256
+#endif
+
+/*! Number of uart_write_const() messages that can wait to be sent on
+ *  each channel. Must be a power of two. */
+#ifndef UART_TX_SEGMENTS
+#define UART_TX_SEGMENTS 16
+#endif
+
+/*! Most bytes sent in one go (one DMA transfer) before the channels
+ *  are checked again. This bounds how long output on a higher priority
+ *  channel waits behind a lower one: 32 bytes take under 3 ms at
+ *  115200 baud. */
+#ifndef UART_TX_BLOCK_LIMIT
+#define UART_TX_BLOCK_LIMIT 32
+#endif
+
+/*! Set to 1 to drain the transmit ring with DMA instead of the
+ *  transmit-empty interrupt. Each transfer covers every byte queued
+ *  contiguously in the ring, so the CPU takes one interrupt per block
+ *  rather than one per character. */
+#ifndef UART_TX_DMA
+#define UART_TX_DMA 1
+#endif
+
+/*! Set to 1 to receive into a circular buffer with DMA instead of
+ *  taking an interrupt per character. Data is handed to the receive
+ *  callback when the line goes idle and each time half of the buffer
+ *  fills, so there is roughly one interrupt per burst. */
+#ifndef UART_RX_DMA
+#define UART_RX_DMA 1
+#endif
+
+/*! Size of the circular DMA receive buffer in bytes. It must hold
+ *  everything that can arrive while receive interrupts are held off. */
+#ifndef UART_RX_DMA_BUFFER_SIZE
+#define UART_RX_DMA_BUFFER_SIZE 64
+#endif
+
+/*! Longest line the line discipline collects, including its
+ *  terminating NUL. */
+#ifndef UART_LINE_SIZE
+#define UART_LINE_SIZE 128
+#endif
+
+/*! Set to 1 to use RTS/CTS flow control on the ports that have the pins
+ *  for it: USART2 on PA1 (RTS) and PA0 (CTS), USART1 on PA12 (RTS) and
+ *  PA11 (CTS). CTS is handled by the USART, which holds off transmission
+ *  while the other end deasserts it. RTS is driven by uart_rx_pause()
+ *  and uart_rx_resume() instead of the USART, whose own RTS only
+ *  reflects a single unread character and so never deasserts while DMA
+ *  receives. */
+#ifndef UART_FLOW_CONTROL
+#define UART_FLOW_CONTROL 0
+#endif
+
+/*! The USART instances the driver can run, with their pins and DMA
+ *  streams. */
+typedef enum {
+	UART_PORT_1, //!< USART1: TX PA9, RX PA10; DMA2 Stream7 (TX) and Stream2 (RX).
+	UART_PORT_2, //!< USART2: TX PA2, RX PA3; DMA1 Stream6 (TX) and Stream5 (RX). The ST-LINK virtual COM port.
+	UART_PORT_6, //!< USART6: TX PC6, RX PC7; DMA2 Stream6 (TX) and Stream1 (RX).
+	UART_PORT_COUNT
+} UartPort;
+
+/*! What uart_tx(), uart_write() and uart_print() do when the transmit ring cannot
+ *  hold the whole message. */
+typedef enum {
+	UART_TX_BLOCK,    //!< Wait for the interrupt handler to make room.
+	UART_TX_DROP,     //!< Discard the whole message.
+	UART_TX_TRUNCATE, //!< Queue as much as fits and discard the rest.
+	UART_TX_COALESCE  //!< Discard what the channel has waiting, except a block already being sent, so the newest message replaces it. uart_printf() writes in pieces, so the cut can fall inside a message.
+} UartTxPolicy;
+
+/*! Transmit channels, highest priority first. Each has its own rings
+ *  and full-ring policy. Whenever the USART is free, the highest
+ *  priority channel with anything waiting is sent next, so a flood of
+ *  low priority output cannot hold up typing echo. */
+typedef enum {
+	UART_CHANNEL_ECHO,    //!< Echo of typed characters. Default policy UART_TX_DROP.
+	UART_CHANNEL_STATUS,  //!< Prompts and results; where uart_write() and friends go. Default UART_TX_BLOCK.
+	UART_CHANNEL_VERBOSE, //!< Progress messages. Default UART_TX_COALESCE.
+	UART_CHANNEL_COUNT
+} UartChannel;
+
+/*! Receive errors, passed as a bit mask to the error callback. */
+typedef enum {
+	UART_ERROR_PARITY  = 0x01, //!< Parity bit did not match.
+	UART_ERROR_FRAMING = 0x02, //!< Stop bit missing, e.g. a baud rate mismatch.
+	UART_ERROR_NOISE   = 0x04, //!< Noise detected within a bit.
+	UART_ERROR_OVERRUN = 0x08  //!< A character arrived before the last was read and was lost.
+} UartError;
+
+/*! Number of receive errors of each kind. */
+typedef struct {
+	uint32_t parity;
+	uint32_t framing;
+	uint32_t noise;
+	uint32_t overrun;
+} UartErrorCounts;
+
+/*! A baud rate divider and how close it comes to the rate asked for. */
+typedef struct {
+	uint32_t requested; //!< Rate asked for, in baud.
+	uint32_t actual;    //!< Rate the divider produces, in baud.
+	int32_t error_ppm;  //!< (actual - requested) / requested, in parts per million.
+	uint16_t brr;       //!< Value for the BRR register.
+	uint8_t over8;      //!< 1 if 8x oversampling is used, 0 for 16x.
+} UartBaud;
+
+/*! Constant data queued by reference with uart_write_const(). It is
+ *  sent once the transmit ring has been drained up to \a position,
+ *  the ring's tail when the segment was queued, which keeps it in
+ *  order with the characters copied around it. */
+typedef struct {
+	uint32_t position; //!< Transmit ring position the data follows.
+	const uint8_t *data; //!< First byte to send.
+	uint32_t length; //!< Number of bytes to send.
+} UartTxSegment;
+
+/*! Output waiting on one transmit channel. */
+typedef struct {
+	Queue queue; //!< Characters waiting to be sent.
+	uint8_t data[UART_TX_BUFFER_SIZE]; //!< Storage for \a queue.
+	Ring segments; //!< Constant data waiting to be sent.
+	UartTxSegment segment_data[UART_TX_SEGMENTS]; //!< Storage for \a segments.
+	uint32_t segment_offset; //!< Bytes of the oldest segment already sent.
+	UartTxPolicy policy; //!< What to do when \a queue is full.
+} UartTxChannel;
+
+/*! This structure holds the state of one USART instance.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by uart.h.
+ */
+typedef struct {
+	const struct UartPortConfig *port; //!< Registers, pins and DMA streams of the instance.
+	UartTxChannel tx[UART_CHANNEL_COUNT]; //!< Output waiting on each channel.
+	UartTxChannel *tx_block_channel; //!< Channel the block being sent is from.
+	int tx_block_is_segment; //!< Whether the block being sent is from a segment.
+#if UART_TX_DMA
+	uint32_t tx_dma_length; //!< Bytes handed to DMA and not yet released; zero while idle.
+#endif
+#if UART_RX_DMA
+	uint8_t rx_dma_buffer[UART_RX_DMA_BUFFER_SIZE]; //!< Circular buffer DMA receives into.
+	uint32_t rx_dma_read; //!< Index of the first received byte not yet delivered.
+#endif
+	volatile int rx_paused; //!< Set while RTS asks the other end to stop sending.
+	char line_buffer[2][UART_LINE_SIZE]; //!< Lines being typed and waiting to be released.
+	uint32_t line_length[2]; //!< Characters in each line buffer.
+	uint8_t line_fill; //!< Buffer being typed into; 2 while both are held.
+	uint8_t line_held; //!< Bit mask of buffers delivered and not yet released.
+	uint8_t line_oldest; //!< Held buffer to release first.
+	volatile int line_suspended; //!< Set from a zero byte until uart_line_resume().
+	void (*line_callback)(const char *line, uint32_t len); //!< Called with each completed line.
+	void (*rx_callback)(uint8_t c); //!< Called with each received character.
+	void (*rx_chunk_callback)(const uint8_t *data, uint32_t len); //!< Called with each run of received characters.
+	void (*error_callback)(uint32_t errors); //!< Called with each receive error.
+	UartErrorCounts error_counts; //!< Receive errors seen since the last reset.
+	UartBaud baud; //!< Divider chosen by uart_init().
+} Uart;
 
 /*! \brief Initialises the UART controller.
+ *  The divider is worked out from the frequency of the bus clock of
+ *  the port (PCLK1 for USART2, PCLK2 for USART1 and USART6) with
+ *  integer arithmetic only, switching to 8x oversampling for rates
+ *  above PCLK / 16 (up to PCLK / 8). See uart_get_baud() for the
+ *  rate actually achieved.
+ *  \param uart  UART structure to operate on. It must stay valid for
+ *               as long as the port is in use.
+ *  \param port  USART instance to drive. Each may only have one
+ *               Uart at a time.
  *  \param baud  Baud rate to be used (symbols per second).
  */
-void uart_init(uint32_t baud);
+void uart_init(Uart *uart, UartPort port, uint32_t baud);
+
+/*! \brief Works out the divider for a baud rate without touching the
+ *         hardware, e.g. to list which rates a clock can reach.
+ *  \param pclk     Frequency of the clock feeding the USART, in Hz.
+ *  \param baud     Requested baud rate.
+ *  \param setting  Filled in with the divider and resulting rate.
+ *  \return True (1) if the divider is in range, false (0) if the
+ *          rate is too high or too low and was clamped.
+ */
+int uart_baud_calc(uint32_t pclk, uint32_t baud, UartBaud *setting);
+
+/*! \brief Reports the divider chosen by uart_init().
+ *  \param uart     UART structure to operate on.
+ *  \param setting  Where the setting is copied to.
+ */
+void uart_get_baud(Uart *uart, UartBaud *setting);
 
 /*! \brief Enables UART transmission and reception.
+ *  \param uart  UART structure to operate on.
  */
-void uart_enable(void);
+void uart_enable(Uart *uart);
 
-/*! \brief Transmit a single character.
- *  \param c  Character to be sent.
+/*! \brief Transmit a single character on UART_CHANNEL_STATUS.
+ *  The character is queued in the transmit ring and sent by the
+ *  transmit interrupt or DMA (see UART_TX_DMA), so this returns without waiting for the line.
+ *  \param uart  UART structure to operate on.
+ *  \param c     Character to be sent.
  */
-void uart_tx(uint8_t c);
+void uart_tx(Uart *uart, uint8_t c);
 
 /*! \brief Receive a single character.
  *  \warning This function blocks until a character is
  *           available. For a non-blocking receive, see
- *           uart_set_rx_callback().
+ *           uart_set_rx_callback(). It must not be used once a
+ *           receive callback is set.
+ *  \param uart  UART structure to operate on.
  *  \return Received character.
  */
-uint8_t uart_rx(void);
+uint8_t uart_rx(Uart *uart);
+
+/*! \brief Transmit a block of bytes on UART_CHANNEL_STATUS.
+ *  The bytes are copied into the transmit ring (in at most two
+ *  blocks, either side of its wrap point) and sent like uart_tx().
+ *  \param uart  UART structure to operate on.
+ *  \param buf   Bytes to be sent.
+ *  \param len   Number of bytes.
+ */
+void uart_write(Uart *uart, const void *buf, size_t len);
+
+/*! \brief Transmit a block of bytes on the given channel, as
+ *         uart_write() does for UART_CHANNEL_STATUS.
+ *  \param uart     UART structure to operate on.
+ *  \param channel  Channel to queue the bytes on.
+ *  \param buf      Bytes to be sent.
+ *  \param len      Number of bytes.
+ */
+void uart_channel_write(Uart *uart, UartChannel channel, const void *buf, size_t len);
 
 /*! \brief Transmit a null terminated string.
- *  \param str  String to be sent.
+ *  Queued like uart_write(), after measuring the string. Where the
+ *  length is already known, call uart_write() directly.
+ *  \param uart  UART structure to operate on.
+ *  \param str   String to be sent.
+ */
+void uart_print(Uart *uart, const char *str);
+
+/*! \brief Transmit formatted text.
+ *  A small subset of printf(): %c, %d, %u, %x and %s, with an
+ *  optional l (as in %lu), and %%. There are no widths or flags.
+ *  Text and converted numbers go straight into the transmit ring
+ *  with uart_write(), so there is no buffer for the whole message;
+ *  output from an interrupt handler may appear between the pieces.
+ *  \param uart    UART structure to operate on.
+ *  \param format  Format string.
+ *  \return Number of characters written.
+ */
+int uart_printf(Uart *uart, const char *format, ...);
+
+/*! \brief Transmit formatted text on the given channel, as
+ *         uart_printf() does for UART_CHANNEL_STATUS.
+ *  \param uart     UART structure to operate on.
+ *  \param channel  Channel to queue the text on.
+ *  \param format   Format string.
+ *  \return Number of characters written.
+ */
+int uart_channel_printf(Uart *uart, UartChannel channel, const char *format, ...);
+
+/*! \brief Transmit formatted text on the given channel, with the
+ *         arguments in a va_list, for wrappers around uart_printf().
+ *  \param uart     UART structure to operate on.
+ *  \param channel  Channel to queue the text on.
+ *  \param format   Format string.
+ *  \param args     Arguments for \a format.
+ *  \return Number of characters written.
+ */
+int uart_channel_vprintf(Uart *uart, UartChannel channel, const char *format, va_list args);
+
+/*! \brief Transmit constant data on UART_CHANNEL_STATUS without
+ *         copying it.
+ *  Only a pointer and length are queued, in order with other output,
+ *  and the bytes are read from \a data as they are sent, so the cost
+ *  does not depend on \a len. \a data must stay unchanged until then,
+ *  which makes this suited to string literals and other data in flash.
+ *  If too many messages are already waiting the bytes are copied as
+ *  uart_write() would.
+ *  \param uart  UART structure to operate on.
+ *  \param data  Bytes to be sent.
+ *  \param len   Number of bytes.
+ */
+void uart_write_const(Uart *uart, const void *data, size_t len);
+
+/*! \brief Transmit constant data on the given channel, as
+ *         uart_write_const() does for UART_CHANNEL_STATUS.
+ *  \param uart     UART structure to operate on.
+ *  \param channel  Channel to queue the data on.
+ *  \param data     Bytes to be sent.
+ *  \param len      Number of bytes.
+ */
+void uart_channel_write_const(Uart *uart, UartChannel channel, const void *data, size_t len);
+
+/*! \brief Transmit a string literal with uart_write_const(), taking its
+ *         length at compile time.
+ *  \param uart     UART structure to operate on.
+ *  \param literal  String literal to be sent.
+ */
+#define uart_print_literal(uart, literal) uart_write_const((uart), "" literal, sizeof(literal) - 1)
+
+/*! \brief Transmit a string literal on the given channel with
+ *         uart_channel_write_const().
+ *  \param uart     UART structure to operate on.
+ *  \param channel  Channel to queue the literal on.
+ *  \param literal  String literal to be sent.
+ */
+#define uart_channel_print_literal(uart, channel, literal) \
+	uart_channel_write_const((uart), (channel), "" literal, sizeof(literal) - 1)
+
+/*! \brief Selects what happens when a message does not fit in the
+ *         transmit ring of a channel. See UartChannel for the defaults.
+ *  Blocking is not possible from an interrupt handler or with
+ *  interrupts disabled; messages are truncated instead.
+ *  \param uart     UART structure to operate on.
+ *  \param channel  Channel to configure.
+ *  \param policy   Full-ring policy.
+ */
+void uart_set_tx_policy(Uart *uart, UartChannel channel, UartTxPolicy policy);
+
+/*! \brief Waits until every queued character has left the line.
+ *  Must not be called with interrupts disabled.
+ *  \param uart  UART structure to operate on.
  */
-void uart_print(char *str);
+void uart_flush(Uart *uart);
 
 /*! \brief Passes a callback function to the API which is executed during
  *         the receive interrupt handler.
+ *  The callback is called once per received character. It is not
+ *  used while a chunk callback is set.
+ *  \param uart      UART structure to operate on.
  *  \param callback  Callback function.
  */
-void uart_set_rx_callback(void (*callback)(uint8_t c));
+void uart_set_rx_callback(Uart *uart, void (*callback)(uint8_t c));
+
+/*! \brief Passes a callback function to the API which is executed during
+ *         the receive interrupt handler with every run of received
+ *         characters at once.
+ *  With UART_RX_DMA the runs are whatever arrived since the last
+ *  interrupt; without it every run is a single character.
+ *  \param uart      UART structure to operate on.
+ *  \param callback  Callback function. \a data is only valid until
+ *                   it returns.
+ */
+void uart_set_rx_chunk_callback(Uart *uart, void (*callback)(const uint8_t *data, uint32_t len));
+
+/*! \brief Turns on the line discipline, so that typed input arrives a
+ *         line at a time.
+ *  Printable characters are echoed on UART_CHANNEL_ECHO and
+ *  collected, backspace and DEL
+ *  erase the last one, and CR (echoed as CR LF) completes the line,
+ *  which is passed to \a callback from the receive interrupt. Other
+ *  control characters are ignored and characters beyond
+ *  UART_LINE_SIZE - 1 are dropped. The receive callbacks still see
+ *  every character, e.g. to react to a key press, but should not
+ *  collect them.
+ *
+ *  A zero byte, which starts binary data such as COBS frames, is not
+ *  edited: it and everything after it go only to the receive
+ *  callbacks until uart_line_resume() is called.
+ *
+ *  Two line buffers are used in turn, so one line can be typed while
+ *  the previous one is handled. A line stays valid until it is
+ *  released with uart_line_release(); while two lines are held,
+ *  typed characters are dropped.
+ *  \param uart      UART structure to operate on.
+ *  \param callback  Callback function. \a line is NUL terminated.
+ */
+void uart_set_line_callback(Uart *uart, void (*callback)(const char *line, uint32_t len));
+
+/*! \brief Gets the oldest completed line that has not been released.
+ *  \param uart  UART structure to operate on.
+ *  \param line  Set to the NUL terminated line.
+ *  \param len   Set to its length.
+ *  \return True (1) if there was a line, false (0) otherwise.
+ */
+int uart_line_peek(Uart *uart, const char **line, uint32_t *len);
+
+/*! \brief Gives the oldest completed line back to the driver.
+ *  \param uart  UART structure to operate on.
+ */
+void uart_line_release(Uart *uart);
+
+/*! \brief Returns to line editing after a zero byte suspended it.
+ *  \param uart  UART structure to operate on.
+ */
+void uart_line_resume(Uart *uart);
+
+/*! \brief Checks whether received characters are being edited into lines.
+ *  \param uart  UART structure to operate on.
+ *  \return True (1) if a line callback is set and the line discipline
+ *          is not suspended, false (0) otherwise.
+ */
+int uart_line_is_active(Uart *uart);
+
+/*! \brief Asks the other end to stop sending by deasserting RTS.
+ *  Characters already on their way are still received, so call this
+ *  with room to spare. Without UART_FLOW_CONTROL, or on a port with
+ *  no RTS pin, only the paused state is recorded. May be called from
+ *  the receive callback.
+ *  \param uart  UART structure to operate on.
+ */
+void uart_rx_pause(Uart *uart);
+
+/*! \brief Asserts RTS again after uart_rx_pause().
+ *  \param uart  UART structure to operate on.
+ */
+void uart_rx_resume(Uart *uart);
+
+/*! \brief Checks whether reception is paused.
+ *  \param uart  UART structure to operate on.
+ *  \return True (1) between uart_rx_pause() and uart_rx_resume(),
+ *          false (0) otherwise.
+ */
+int uart_rx_is_paused(Uart *uart);
+
+/*! \brief Passes a callback function to the API which is executed during
+ *         the receive interrupt handler whenever a receive error is
+ *         detected. Errors are counted whether or not it is set.
+ *  \param uart      UART structure to operate on.
+ *  \param callback  Callback function. \a errors is a mask of
+ *                   UartError values.
+ */
+void uart_set_error_callback(Uart *uart, void (*callback)(uint32_t errors));
+
+/*! \brief Copies the receive error counters.
+ *  \param uart    UART structure to operate on.
+ *  \param counts  Where the counters are copied to.
+ */
+void uart_get_error_counts(Uart *uart, UartErrorCounts *counts);
+
+/*! \brief Zeroes the receive error counters.
+ *  \param uart  UART structure to operate on.
+ */
+void uart_reset_error_counts(Uart *uart);
 
 #endif // UART_H
 
-// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************   
+// *******************************ARM University Program Copyright © ARM Ltd 2016*************************************
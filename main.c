@@ -1,36 +1,99 @@
 #include "main.h"
-#include <stdio.h>
 #include <string.h>
 
 // Definitions
 #define BUFF_SIZE 128
+#define RX_QUEUE_SIZE 128 // Binary frame bytes; must be a power of two
+#define RX_HIGH_WATER (RX_QUEUE_SIZE - UART_RX_DMA_BUFFER_SIZE) // Pause the sender here, leaving room for what is already in flight
+#define RX_LOW_WATER (RX_QUEUE_SIZE / 4) // Resume once drained to here
 #define BUTTON_PIN PC_13
+#define UART_BAUD 115200 // Up to PCLK1 / 8; the achieved rate is printed at start-up
 #define DIGIT_ANALYSIS_INTERVAL_MS 500
 #define LED_BLINK_INTERVAL_MS 200
 
+// Binary input frames, for feeding numbers in bulk without echo. A frame
+// is sent as 0x00, the COBS encoding of the payload, 0x00. The payload
+// is a run of number records followed by the CRC-32 (see crc.h) of the
+// records, least significant byte first. Each record is:
+//   flags (FRAME_FLAG_*), length (1 to BUFF_SIZE - 1), that many ASCII digits
+// A frame is checked and all of its numbers queued at once; they are
+// analysed one after another, behind any analysis already running.
+// A frame that outgrows FRAME_BUFFER_SIZE, is hit by a receive error or
+// stops arriving for FRAME_TIMEOUT_MS is dropped and typing resumes, so a
+// stray 0x00, from line noise or a sender reset mid-frame, cannot leave the
+// console ignoring what is typed.
+#define FRAME_BUFFER_SIZE 256 // Encoded bytes between the delimiters
+#define FRAME_TIMEOUT_MS 100 // Longest gap within a frame
+#define FRAME_CRC_SIZE 4
+#define FRAME_FLAG_CONTINUOUS 0x01 // Repeat the analysis until new input arrives
+#define PENDING_NUMBERS_SIZE 256 // Bytes of queued records; must be a power of two
+
 // Application States
 typedef enum {
     APP_STATE_INIT,
     APP_STATE_IDLE,
-    APP_STATE_RECEIVING_INPUT,
     APP_STATE_START_ANALYSIS,
     APP_STATE_ANALYZING_DIGIT,
     APP_STATE_CONTINUOUS_BLINK 
 } AppState;
 
+// Events posted by ISRs to the main loop
+typedef enum {
+    APP_EVENT_BUTTON,   // Button pressed, arg is the GPIO pin mask
+    APP_EVENT_NEW_INPUT, // Character received during analysis/blinking, arg is the character
+    APP_EVENT_LINE_READY, // A typed line is complete, arg is its length
+    APP_EVENT_UART_ERROR // Receive error on the UART, arg is the UartError mask
+} AppEventType;
+
+typedef struct {
+    AppEventType type;
+    int32_t arg;
+    uint32_t cycles; // cycles_now() when the ISR posted it
+} AppEvent;
+
+// Timed actions, scheduled on the deadlines queue
+typedef enum {
+    DEADLINE_NEXT_DIGIT, // Move on to the next digit
+    DEADLINE_BLINK,      // Toggle the blinking LED
+    DEADLINE_FRAME_TIMEOUT // Give up on a frame that stopped arriving
+} DeadlineEvent;
+
+// Diagnostic trace of recent UART traffic and state changes
+typedef enum {
+    TRACE_RX_CHAR, // value is the received character
+    TRACE_STATE    // value is the new AppState
+} TraceKind;
+
+typedef struct {
+    uint32_t time_ms;
+    uint8_t kind;
+    uint8_t value;
+} TraceRecord;
+
 // Global state variables
 static AppState current_app_state = APP_STATE_INIT;
 static bool continuous_mode_active = false;
 static bool lock_message_was_printed = false;
 
+// Console on USART2, the ST-LINK virtual COM port. Diagnostics go through log.h;
+// per-digit progress is LOG_DEBUG, which gives way to echo and prompts when the link is busy.
+static Uart console;
+
 // Input Buffers
-static Queue rx_queue;
+QUEUE_DEFINE(rx_queue, RX_QUEUE_SIZE);
 static char input_buffer[BUFF_SIZE];
 static uint8_t input_buffer_idx = 0;
 static char processed_number[BUFF_SIZE];
 static uint8_t processed_number_len = 0;
 static uint8_t current_digit_idx = 0;
 
+// Binary Frames
+static uint8_t frame_buffer[FRAME_BUFFER_SIZE];
+static uint32_t frame_len = 0;
+static bool frame_active = false; // Between the opening and closing 0x00
+static uint32_t rx_errors_seen = 0; // Receive errors counted by the driver when receive_frames() last looked
+QUEUE_DEFINE(pending_numbers, PENDING_NUMBERS_SIZE); // Records from frames waiting for analysis
+
 // LED & Button Status
 static bool led_current_state_on = false;
 static bool led_should_blink = false;
@@ -39,30 +102,45 @@ static bool led_frozen = false;
 
 // Timer Counters
 static volatile uint32_t system_ms_counter = 0; // Incremented by 1ms timer ISR
-static uint32_t last_digit_analysis_time = 0;
-static uint32_t last_led_blink_time = 0;
+DEADLINE_QUEUE_DEFINE(deadlines, 4); // Pending DeadlineEvents, earliest first
+
+// Events from all ISRs, in the order they happened
+EVENT_QUEUE_DEFINE(app_events, AppEvent, 16);
 
-// Event Flags (set by ISRs, cleared by main loop)
-static volatile bool uart_char_received_flag = false;
-static volatile uint8_t received_uart_char = 0;
-static volatile bool button_pressed_flag = false;
-static volatile bool new_input_interrupt_flag = false; // If new input during analysis
+// Last TRACE_LOG_SIZE trace records, written in overwrite mode so logging
+// never stalls an ISR. Read back with event_queue_get_overwrite().
+#define TRACE_LOG_SIZE 32
+EVENT_QUEUE_DEFINE(trace_log, TraceRecord, TRACE_LOG_SIZE);
 
 // Function Prototypes for State Handlers
 static void handle_init_state(void);
 static void handle_idle_state(void);
-static void handle_receiving_input_state(void);
 static void handle_start_analysis_state(void);
-static void handle_analyzing_digit_state(void);
-static void handle_continuous_blink_state(void);
+
+// Event Handlers
+static void handle_new_input_event(void);
+static void handle_line_event(void);
+static void handle_log_command(const char *arg);
+static void handle_button_event(const AppEvent *event);
+static void handle_uart_error_event(void);
+static void handle_next_digit_deadline(void);
+static void handle_blink_deadline(void);
+static void handle_frame_timeout_deadline(void);
 
 // Helper Functions
+static void trace(TraceKind kind, uint8_t value);
 static void set_led_output(bool on);
-static void process_received_char(uint8_t c);
 static void filter_and_prepare_number(void);
 static void initiate_digit_analysis(void);
 static void perform_current_digit_analysis(void);
+static void schedule_digit_deadlines(void);
+static bool main_loop_idle(void);
+static void resume_rx_if_drained(void);
 static void reset_for_new_input(void);
+static void receive_frames(void);
+static void process_frame(void);
+static void drop_frame(void);
+static bool start_pending_number(void);
 
 // ISRs
 void timer_1ms_callback(void) { // Assuming a 1ms timer is configured
@@ -70,32 +148,58 @@ void timer_1ms_callback(void) { // Assuming a 1ms timer is configured
     // Flags for specific intervals can be set here if needed, or checked in main loop
 }
 
-void uart_rx_isr(uint8_t rx_data) {
-    if (queue_is_full(&rx_queue)) { // Or however you check queue full
-        // Optional: Handle queue full error, maybe log or ignore
+void uart_rx_chunk_isr(const uint8_t *data, uint32_t len) {
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        trace(TRACE_RX_CHAR, data[i]);
+    }
+    if (uart_line_is_active(&console)) {
+        // Key presses, which the driver collects into lines. They only
+        // matter here to interrupt an analysis or blinking.
+        if (current_app_state == APP_STATE_ANALYZING_DIGIT ||
+            current_app_state == APP_STATE_CONTINUOUS_BLINK) {
+            AppEvent event = { APP_EVENT_NEW_INPUT, data[0], cycles_now() };
+            event_queue_post(&app_events, &event);
+        }
         return;
     }
-    queue_enqueue(&rx_queue, rx_data); // Enqueue the character
-    uart_char_received_flag = true;    // Signal main loop
-
-    // If analysis or blinking is active, new UART input is an interruption
-    if (current_app_state == APP_STATE_ANALYZING_DIGIT || 
-        current_app_state == APP_STATE_CONTINUOUS_BLINK) {
-        new_input_interrupt_flag = true;
+    // Binary data after a 0x00, until receive_frames() hands typing back to the driver
+    if (queue_enqueue_n(&rx_queue, data, len) == 0) { // Queue full, drop the characters (counted with QUEUE_STATS)
+        return;
+    }
+    if (queue_count(&rx_queue) > RX_HIGH_WATER) {
+        uart_rx_pause(&console); // Deasserts RTS when UART_FLOW_CONTROL is enabled
     }
 }
 
+void uart_line_isr(const char *line, uint32_t len) {
+    AppEvent event = { APP_EVENT_LINE_READY, (int32_t)len, cycles_now() };
+    event_queue_post(&app_events, &event); // The line stays in the driver until handle_line_event() takes it
+}
+
+void uart_error_isr(uint32_t errors) {
+    AppEvent event = { APP_EVENT_UART_ERROR, (int32_t)errors, cycles_now() };
+    event_queue_post(&app_events, &event); // Dropped if full; the driver still counts every error
+}
+
 void button_isr(int status) {
-    button_pressed_flag = true;
+    AppEvent event = { APP_EVENT_BUTTON, status, cycles_now() };
+    event_queue_post(&app_events, &event); // Full queue means presses are arriving faster than we can report
 }
 
 int main(void) {
     
     // Initialize Peripherals
-    queue_init(&rx_queue, 128); // Initialize RX queue
-    uart_init(115200);          // Initialize UART
-    uart_set_rx_callback(uart_rx_isr);
-    uart_enable();
+    cycles_init(); // Time stamps for events, before any ISR can post one
+    uart_init(&console, UART_PORT_2, UART_BAUD); // Initialize UART
+    uart_set_rx_chunk_callback(&console, uart_rx_chunk_isr);
+    uart_set_line_callback(&console, uart_line_isr); // Echo and line editing happen in the driver
+    log_init(&console);
+    log_set_clock(timer_ms_clock_init()); // Not system_ms_counter, which stops with the tick
+    uart_set_error_callback(&console, uart_error_isr);
+    uart_enable(&console);
+    crc_init();
 
     leds_init(); // Initialize LEDs
 
@@ -113,37 +217,45 @@ int main(void) {
     __enable_irq(); // Enable global interrupts
 
     current_app_state = APP_STATE_INIT;
+    AppState traced_state = current_app_state;
 
     while (1) {
-        if (new_input_interrupt_flag) {
-            uart_print("\r\nAnalysis interrupted by new input.\r\n");
-            uart_print("Enter number:");
-            led_should_blink = false;
-            reset_for_new_input();
-            set_led_output(false); // Explicitly turn LED off on interrupt
-            current_app_state = APP_STATE_IDLE;
-            new_input_interrupt_flag = false;
-            uint8_t temp_val;
-            while(queue_dequeue(&rx_queue, &temp_val)); // Clear queue
-            uart_char_received_flag = false; 
+        AppState pass_start_state = current_app_state;
+        AppEvent event;
+        uint32_t due;
+        while (event_queue_get(&app_events, &event)) {
+            switch (event.type) {
+                case APP_EVENT_NEW_INPUT:
+                    handle_new_input_event();
+                    break;
+                case APP_EVENT_LINE_READY:
+                    handle_line_event();
+                    break;
+                case APP_EVENT_BUTTON:
+                    handle_button_event(&event);
+                    break;
+                case APP_EVENT_UART_ERROR:
+                    handle_uart_error_event();
+                    break;
+            }
         }
 
-        if (button_pressed_flag) {
-            button_press_counter++;
-            led_frozen = !led_frozen; // Toggle frozen state
-
-            if (led_frozen) {
-                uart_print("\r\nButton Press: LED functionality LOCKED. Press count: ");
-            } else {
-                uart_print("\r\nButton Press: LED functionality RESTORED. Press count: ");
-                // When unlocking, immediately apply the current logical LED state
-                // to the physical LED. set_led_output will now allow leds_set().
-                set_led_output(led_current_state_on);
+        while (deadline_queue_pop_due(&deadlines, system_ms_counter, &due)) {
+            switch (due) {
+                case DEADLINE_NEXT_DIGIT:
+                    handle_next_digit_deadline();
+                    break;
+                case DEADLINE_BLINK:
+                    handle_blink_deadline();
+                    break;
+                case DEADLINE_FRAME_TIMEOUT:
+                    handle_frame_timeout_deadline();
+                    break;
             }
-            char temp_str[12];
-            sprintf(temp_str, "%lu\r\n", button_press_counter);
-            uart_print(temp_str);
-            button_pressed_flag = false;
+        }
+
+        if (current_app_state != APP_STATE_INIT) {
+            receive_frames();
         }
 
         // --- State Machine Execution ---
@@ -154,152 +266,217 @@ int main(void) {
             case APP_STATE_IDLE:
                 handle_idle_state();
                 break;
-            case APP_STATE_RECEIVING_INPUT:
-                handle_receiving_input_state();
-                break;
             case APP_STATE_START_ANALYSIS:
                 handle_start_analysis_state();
                 break;
             case APP_STATE_ANALYZING_DIGIT:
-                handle_analyzing_digit_state();
-                break;
             case APP_STATE_CONTINUOUS_BLINK:
-                handle_continuous_blink_state();
+                // Driven by the deadlines queue
                 break;
             default:
                 // Should not happen, reset to a safe state
                 current_app_state = APP_STATE_IDLE;
                 break;
         }
-        //__WFI();
+
+        resume_rx_if_drained();
+
+        if (current_app_state != traced_state) {
+            traced_state = current_app_state;
+            trace(TRACE_STATE, traced_state);
+            LOG_TRACE("State %d\r\n", traced_state);
+        }
+
+        // Sleep until the next interrupt if there is nothing to do. The
+        // 1ms tick wakes us to check the earliest deadline. Interrupts are
+        // masked around the check so one cannot slip in between the check
+        // and the WFI; a pending interrupt still wakes the core.
+        __disable_irq();
+        if (current_app_state == pass_start_state && main_loop_idle()) {
+            __WFI();
+        }
+        __enable_irq();
     }
 }
 
 void handle_init_state(void) {
-    uart_print("\r\n*** Digit Analysis System ***\r\n");
+    uart_print_literal(&console, "\r\n*** Digit Analysis System ***\r\n");
+    UartBaud baud;
+    uart_get_baud(&console, &baud);
+    LOG_INFO("UART %lu baud, actual %lu (%ld ppm)\r\n", (unsigned long)baud.requested,
+             (unsigned long)baud.actual, (long)baud.error_ppm);
     reset_for_new_input();
     set_led_output(false); // Explicitly turn LED off during system init
     current_app_state = APP_STATE_IDLE;
 }
 
 void handle_idle_state(void) {
-    // Check for new character from UART to start receiving input
+    // Typed lines arrive as APP_EVENT_LINE_READY; here only queued frame numbers are started
     // Only print prompt once when entering IDLE from a state that's not INIT (which prints its own welcome)
     static AppState last_state_before_idle = APP_STATE_INIT;
     if (last_state_before_idle != APP_STATE_IDLE && current_app_state == APP_STATE_IDLE) {
-        uart_print("Enter number: ");
+        uart_print_literal(&console, "Enter number: ");
     }
     last_state_before_idle = current_app_state; // Update for next cycle
 
-    if (uart_char_received_flag) {
-        current_app_state = APP_STATE_RECEIVING_INPUT;
-        // LED state is preserved from previous operation unless explicitly changed
-    }
-}
-
-void handle_receiving_input_state(void) {
-    if (uart_char_received_flag) {
-        uint8_t c;
-        if (queue_dequeue(&rx_queue, &c)) {
-            process_received_char(c); // Echoes and adds to buffer
-        }
-        uart_char_received_flag = false; // Consume the flag
-
-        if (c == '\r' || input_buffer_idx >= BUFF_SIZE -1) {
-            uart_print("\r\n");
-            filter_and_prepare_number();
-            if (processed_number_len > 0) {
-                current_app_state = APP_STATE_START_ANALYSIS;
-            } else {
-                uart_print("No valid digits entered.\r\n");
-                reset_for_new_input();
-                current_app_state = APP_STATE_IDLE; // Back to idle to re-prompt
-            }
-        }
+    if (start_pending_number()) {
+        current_app_state = APP_STATE_START_ANALYSIS;
     }
 }
 
 void handle_start_analysis_state(void) {
-    uart_print("Starting analysis...\r\n");
+    LOG_DEBUG("Starting analysis...\r\n");
     initiate_digit_analysis(); // Sets up current_digit_idx, calls perform_current_digit_analysis for first digit
                                // and enables timer if needed.
     current_app_state = APP_STATE_ANALYZING_DIGIT;
-    last_digit_analysis_time = system_ms_counter;
-    last_led_blink_time = system_ms_counter;
+    schedule_digit_deadlines();
+}
+
+// --- Event Handler Implementations ---
+void handle_new_input_event(void) {
+    // Several characters may arrive before we get here; only the first one interrupts
+    if (current_app_state != APP_STATE_ANALYZING_DIGIT &&
+        current_app_state != APP_STATE_CONTINUOUS_BLINK) {
+        return;
+    }
+    LOG_INFO("\r\nAnalysis interrupted by new input.\r\n");
+    uart_print_literal(&console, "Enter number:");
+    led_should_blink = false;
+    reset_for_new_input(); // The key that interrupted starts the next line
+    set_led_output(false); // Explicitly turn LED off on interrupt
+    current_app_state = APP_STATE_IDLE;
 }
 
-void handle_analyzing_digit_state(void) {
-    // Check for digit analysis interval
-    if ((system_ms_counter - last_digit_analysis_time) >= DIGIT_ANALYSIS_INTERVAL_MS) {
-        current_digit_idx++;
-        if (current_digit_idx < processed_number_len) {
-            perform_current_digit_analysis();
-            last_digit_analysis_time = system_ms_counter;
-            last_led_blink_time = system_ms_counter; // Reset blink time for new digit
+void handle_line_event(void) {
+    const char *line;
+    uint32_t len;
+
+    // One event may be lost to a full queue, so take every line the driver holds
+    while (uart_line_peek(&console, &line, &len)) {
+        if (strncmp(line, "log ", 4) == 0) {
+            handle_log_command(line + 4);
+            uart_line_release(&console);
+            continue;
+        }
+        // A line can complete before its first key interrupted a running analysis
+        reset_for_new_input();
+        input_buffer_idx = (uint8_t)(len < BUFF_SIZE - 1 ? len : BUFF_SIZE - 1);
+        memcpy(input_buffer, line, input_buffer_idx);
+        input_buffer[input_buffer_idx] = '\0';
+        uart_line_release(&console);
+
+        filter_and_prepare_number();
+        if (processed_number_len > 0) {
+            current_app_state = APP_STATE_START_ANALYSIS;
         } else {
-            // Analysis complete
-            uart_print("Analysis complete. \r\n");
-            if (continuous_mode_active) {
-                uart_print("Continuous mode: Restarting analysis.\r\n");
-
-                current_digit_idx = 0; // Reset for re-analysis
-
-                current_app_state = APP_STATE_START_ANALYSIS; 
-            } else if (led_should_blink) { 
-                current_app_state = APP_STATE_CONTINUOUS_BLINK;
-                 uart_print("Continuous LED blinking.\r\n");
-            } else {
-                // Analysis of a non-continuous, non-blinking number is complete.
-                // LED should remain in the state set by the last odd digit.
-                timer_disable(); // Stop the SysTick timer if it's only for analysis/blinking
-                // set_led_output(led_current_state_on); // LED is already in its final state from perform_current_digit_analysis
-                
-                // Reset necessary flags and buffers for the next input cycle, but preserve LED state.
-                input_buffer_idx = 0;
-                input_buffer[0] = '\0';
-                processed_number_len = 0;
-                processed_number[0] = '\0';
-                current_digit_idx = 0; 
-                // led_should_blink is already false
-                // continuous_mode_active is already false
-                // uart_char_received_flag and new_input_interrupt_flag will be handled by their respective logic.
+            LOG_WARN("No valid digits entered.\r\n");
+            reset_for_new_input();
+            current_app_state = APP_STATE_IDLE;
+            uart_print_literal(&console, "Enter number: "); // IDLE only prompts the first time
+        }
+    }
+}
 
-                current_app_state = APP_STATE_IDLE;
-                uart_print("Enter number:");
-            }
-            return; // Exit to avoid immediate blink check
+void handle_log_command(const char *arg) {
+    // "log N" sets the runtime log level, 0 (none) to 5 (trace)
+    if (arg[0] >= '0' && arg[0] <= '9' && arg[1] == '\0') {
+        uart_printf(&console, "Log level %u\r\n", (unsigned int)log_set_level((uint8_t)(arg[0] - '0')));
+    } else {
+        uart_print_literal(&console, "Usage: log 0-5 (none, error, warn, info, debug, trace)\r\n");
+    }
+    if (current_app_state == APP_STATE_IDLE) {
+        uart_print_literal(&console, "Enter number: ");
+    }
+}
+
+void handle_button_event(const AppEvent *event) {
+    button_press_counter++;
+    led_frozen = !led_frozen; // Toggle frozen state
+
+    LOG_INFO("\r\nButton Press: LED functionality %s. Press count: %lu\r\n",
+             led_frozen ? "LOCKED" : "RESTORED", button_press_counter);
+    LOG_DEBUG("Handled %lu cycles after the edge\r\n", (unsigned long)(cycles_now() - event->cycles));
+    if (!led_frozen) {
+        // When unlocking, immediately apply the current logical LED state
+        // to the physical LED. set_led_output will now allow leds_set().
+        set_led_output(led_current_state_on);
+    }
+}
+
+void handle_uart_error_event(void) {
+    UartErrorCounts counts;
+    uart_get_error_counts(&console, &counts);
+    LOG_ERROR("\r\nUART errors: overrun %lu, framing %lu, noise %lu, parity %lu\r\n",
+              counts.overrun, counts.framing, counts.noise, counts.parity);
+}
+
+void handle_next_digit_deadline(void) {
+    current_digit_idx++;
+    if (current_digit_idx < processed_number_len) {
+        perform_current_digit_analysis();
+        schedule_digit_deadlines();
+        return;
+    }
+
+    // Analysis complete
+    LOG_INFO("Analysis complete. \r\n");
+    if (continuous_mode_active && queue_is_empty(&pending_numbers)) {
+        LOG_DEBUG("Continuous mode: Restarting analysis.\r\n");
+
+        current_digit_idx = 0; // Reset for re-analysis
+
+        current_app_state = APP_STATE_START_ANALYSIS; 
+    } else if (led_should_blink && queue_is_empty(&pending_numbers)) {
+        // The pending blink deadline keeps the LED going
+        current_app_state = APP_STATE_CONTINUOUS_BLINK;
+        LOG_INFO("Continuous LED blinking.\r\n");
+    } else {
+        // Analysis of a non-continuous, non-blinking number is complete.
+        // LED should remain in the state set by the last odd digit.
+        // set_led_output(led_current_state_on); // LED is already in its final state from perform_current_digit_analysis
+        
+        // Reset necessary flags and buffers for the next input cycle, but preserve LED state.
+        input_buffer_idx = 0;
+        input_buffer[0] = '\0';
+        processed_number_len = 0;
+        processed_number[0] = '\0';
+        current_digit_idx = 0; 
+        // Only still set if numbers from a frame are waiting; IDLE starts the next one
+        led_should_blink = false;
+        continuous_mode_active = false;
+        deadline_queue_cancel(&deadlines, DEADLINE_BLINK);
+        if (deadline_queue_peek(&deadlines) == 0) {
+            timer_disable(); // Stop the SysTick timer unless a frame is still being timed
         }
+
+        current_app_state = APP_STATE_IDLE;
+        uart_print_literal(&console, "Enter number:");
     }
+}
 
-    // Handle LED blinking if current digit is even
+void handle_blink_deadline(void) {
+    // Active while the current digit is even, and after the analysis if the last digit was even
     if (led_should_blink) {
-        if ((system_ms_counter - last_led_blink_time) >= LED_BLINK_INTERVAL_MS) {
-            led_current_state_on = !led_current_state_on;
-            set_led_output(led_current_state_on);
-            last_led_blink_time = system_ms_counter;
-        }
+        led_current_state_on = !led_current_state_on;
+        set_led_output(led_current_state_on);
+        deadline_queue_insert(&deadlines, system_ms_counter + LED_BLINK_INTERVAL_MS, DEADLINE_BLINK);
     }
 }
 
-void handle_continuous_blink_state(void) {
-    // This state is active when analysis is done, and last digit was even.
-    // UART or Button ISRs can interrupt this state.
-    if (led_should_blink) { // Should always be true here
-         if ((system_ms_counter - last_led_blink_time) >= LED_BLINK_INTERVAL_MS) {
-            led_current_state_on = !led_current_state_on;
-            set_led_output(led_current_state_on);
-            last_led_blink_time = system_ms_counter;
-        }
-    } else {
-        // Should not happen, safety check
+void handle_frame_timeout_deadline(void) {
+    LOG_WARN("Frame dropped: timed out.\r\n");
+    drop_frame(); // receive_frames() then hands typing back to the driver
+    if (deadline_queue_peek(&deadlines) == 0) {
         timer_disable();
-        set_led_output(false);
-        reset_for_new_input();
-        current_app_state = APP_STATE_IDLE;
     }
 }
 
 // --- Helper Function Implementations ---
+void trace(TraceKind kind, uint8_t value) {
+    TraceRecord record = { system_ms_counter, kind, value };
+    event_queue_post_overwrite(&trace_log, &record);
+}
+
 void set_led_output(bool on) {
     led_current_state_on = on; // Always update logical state
     if (!led_frozen) {    // Check if LED is NOT frozen
@@ -307,25 +484,6 @@ void set_led_output(bool on) {
     }
 }
 
-void process_received_char(uint8_t c) {
-    if (c == '\b' || c == 0x7F) { // Handle backspace (ASCII DEL for some terminals)
-        if (input_buffer_idx > 0) {
-            input_buffer_idx--;
-            uart_print("\b \b"); // Erase character on terminal
-        }
-    } else if (c >= 0x20 && c < 0x7F) { // Printable characters (excluding DEL)
-        if (input_buffer_idx < BUFF_SIZE - 1) {
-            input_buffer[input_buffer_idx++] = c;
-            uart_tx(c); // Echo character
-        }
-    } else if (c == '\r') { // Enter key
-        // Handled by main logic in RECEIVING_INPUT state
-        // uart_tx(c); // Echo CR
-        // uart_tx('\n'); // Echo LF
-    }
-    input_buffer[input_buffer_idx] = '\0'; // Null-terminate for safety
-}
-
 void filter_and_prepare_number(void) {
     processed_number_len = 0;
     continuous_mode_active = false; // Reset for current input processing
@@ -340,7 +498,7 @@ void filter_and_prepare_number(void) {
         // Check for trailing '-' for continuous mode
         if (input_buffer[i] == '-' && i == (input_buffer_idx - 1) && processed_number_len > 0) {
              continuous_mode_active = true;
-             uart_print("Continuous mode detected ('-').\r\n");
+             LOG_INFO("Continuous mode detected ('-').\r\n");
              // Don't add '-' to processed_number
              break; // Stop processing once '-' is found at the end
         }
@@ -367,23 +525,211 @@ void perform_current_digit_analysis(void) {
     char digit_char = processed_number[current_digit_idx];
     int digit = digit_char - '0';
 
-    char msg[30];
-    sprintf(msg, "Analyzing digit %c (%d)...\r\n", digit_char, digit);
-    uart_print(msg);
+    LOG_DEBUG("Analyzing digit %c (%d)...\r\n", digit_char, digit);
 
     if (digit % 2 == 0) { // Even digit
-        uart_print("Even digit - LED will blink.\r\n");
+        LOG_DEBUG("Even digit - LED will blink.\r\n");
         led_should_blink = true;
         led_current_state_on = true; // Start by turning LED on for blink
         set_led_output(led_current_state_on);
     } else { // Odd digit
-        uart_print("Odd digit - LED will toggle and stay.\r\n");
+        LOG_DEBUG("Odd digit - LED will toggle and stay.\r\n");
         led_should_blink = false;
         led_current_state_on = !led_current_state_on; // Toggle previous state
         set_led_output(led_current_state_on);
     }
 }
 
+void schedule_digit_deadlines(void) {
+    // Called right after a digit is analysed: the next digit is due one
+    // interval from now, and blinking restarts its phase for this digit.
+    uint32_t now = system_ms_counter;
+
+    deadline_queue_cancel(&deadlines, DEADLINE_NEXT_DIGIT);
+    deadline_queue_cancel(&deadlines, DEADLINE_BLINK);
+    deadline_queue_insert(&deadlines, now + DIGIT_ANALYSIS_INTERVAL_MS, DEADLINE_NEXT_DIGIT);
+    if (led_should_blink) {
+        deadline_queue_insert(&deadlines, now + LED_BLINK_INTERVAL_MS, DEADLINE_BLINK);
+    }
+}
+
+bool main_loop_idle(void) {
+    if (!event_queue_is_empty(&app_events) || !queue_is_empty(&rx_queue) ||
+        deadline_queue_is_due(&deadlines, system_ms_counter)) {
+        return false;
+    }
+    // These states always do work when they run
+    return current_app_state != APP_STATE_INIT &&
+           current_app_state != APP_STATE_START_ANALYSIS;
+}
+
+void resume_rx_if_drained(void) {
+    // Masked so the receive ISR cannot pause between the check and the resume
+    __disable_irq();
+    if (uart_rx_is_paused(&console) && queue_count(&rx_queue) <= RX_LOW_WATER) {
+        uart_rx_resume(&console);
+    }
+    __enable_irq();
+}
+
+void receive_frames(void) {
+    const uint8_t *rx_chars;
+    uint32_t rx_count;
+    uint32_t i;
+    bool received = false;
+    UartErrorCounts counts;
+    uint32_t errors;
+
+    // A bad byte may have been a delimiter, so binary data around one can't be trusted
+    uart_get_error_counts(&console, &counts);
+    errors = counts.overrun + counts.framing + counts.noise + counts.parity;
+    if (errors != rx_errors_seen) {
+        rx_errors_seen = errors;
+        if (!uart_line_is_active(&console)) {
+            LOG_WARN("Frame dropped: receive error.\r\n");
+            drop_frame();
+        }
+    }
+
+    while ((rx_count = queue_peek_contiguous(&rx_queue, &rx_chars)) > 0) {
+        received = true;
+        if (!frame_active) {
+            if (rx_chars[0] != 0x00) {
+                queue_commit(&rx_queue, 1); // Typed before the line discipline was resumed; dropped
+                continue;
+            }
+            queue_commit(&rx_queue, 1);
+            frame_active = true;
+            frame_len = 0;
+            continue;
+        }
+        for (i = 0; i < rx_count && rx_chars[i] != 0x00 && frame_len < FRAME_BUFFER_SIZE; i++) {
+            frame_buffer[frame_len++] = rx_chars[i];
+        }
+        if (i < rx_count && rx_chars[i] != 0x00) {
+            // Longer than any frame, so most likely not one; don't wait for its end
+            LOG_WARN("Frame rejected: too long.\r\n");
+            drop_frame();
+            break;
+        }
+        if (i == rx_count) {
+            queue_commit(&rx_queue, i); // Frame continues after the wrap or in a later chunk
+            continue;
+        }
+        queue_commit(&rx_queue, i + 1);
+        if (frame_len == 0) {
+            continue; // Back-to-back delimiters; this one opens the frame
+        }
+        frame_active = false;
+        process_frame();
+    }
+
+    if (!frame_active) {
+        deadline_queue_cancel(&deadlines, DEADLINE_FRAME_TIMEOUT);
+    } else if (received) {
+        // Each piece of a frame restarts the wait for the rest
+        deadline_queue_cancel(&deadlines, DEADLINE_FRAME_TIMEOUT);
+        deadline_queue_insert(&deadlines, system_ms_counter + FRAME_TIMEOUT_MS, DEADLINE_FRAME_TIMEOUT);
+        timer_enable();
+    }
+
+    // Hand typing back to the driver once the binary data has all been taken.
+    // Masked so no byte can slip into rx_queue between the check and the resume.
+    __disable_irq();
+    if (!frame_active && queue_is_empty(&rx_queue) && !uart_line_is_active(&console)) {
+        uart_line_resume(&console);
+    }
+    __enable_irq();
+}
+
+void process_frame(void) {
+    uint32_t payload_len;
+    uint32_t records_len;
+    uint32_t received_crc;
+    uint32_t pos;
+    uint32_t count = 0;
+
+    if (!cobs_decode(frame_buffer, frame_len, frame_buffer, &payload_len) ||
+        payload_len <= FRAME_CRC_SIZE) {
+        LOG_WARN("Frame rejected: malformed.\r\n");
+        return;
+    }
+    records_len = payload_len - FRAME_CRC_SIZE;
+    received_crc = (uint32_t)frame_buffer[records_len] |
+                   ((uint32_t)frame_buffer[records_len + 1] << 8) |
+                   ((uint32_t)frame_buffer[records_len + 2] << 16) |
+                   ((uint32_t)frame_buffer[records_len + 3] << 24);
+    if (crc_compute(frame_buffer, records_len) != received_crc) {
+        LOG_WARN("Frame rejected: bad CRC.\r\n");
+        return;
+    }
+
+    // Check every record before queueing any, so a frame is taken whole or not at all
+    for (pos = 0; pos < records_len; pos += 2 + frame_buffer[pos + 1]) {
+        uint8_t len;
+        if (pos + 2 > records_len) {
+            break;
+        }
+        len = frame_buffer[pos + 1];
+        if (len == 0 || len > BUFF_SIZE - 1 || pos + 2 + len > records_len) {
+            break;
+        }
+        for (uint8_t i = 0; i < len; i++) {
+            if (frame_buffer[pos + 2 + i] < '0' || frame_buffer[pos + 2 + i] > '9') {
+                len = 0;
+            }
+        }
+        if (len == 0) {
+            break;
+        }
+        count++;
+    }
+    if (pos != records_len) {
+        LOG_WARN("Frame rejected: bad record.\r\n");
+        return;
+    }
+    if (records_len > PENDING_NUMBERS_SIZE - queue_count(&pending_numbers)) {
+        LOG_WARN("Frame rejected: queue full.\r\n");
+        return;
+    }
+    queue_enqueue_n(&pending_numbers, frame_buffer, records_len);
+    LOG_INFO("Frame accepted: %lu numbers queued.\r\n", (unsigned long)count);
+    if (current_app_state == APP_STATE_CONTINUOUS_BLINK) {
+        // Blinking only waits for new input, and these numbers are new input; IDLE starts the first
+        led_should_blink = false;
+        deadline_queue_cancel(&deadlines, DEADLINE_BLINK);
+        current_app_state = APP_STATE_IDLE;
+    }
+}
+
+void drop_frame(void) {
+    const uint8_t *rx_chars;
+    uint32_t rx_count;
+
+    // The binary data behind the frame goes too: its delimiters can't be trusted either
+    while ((rx_count = queue_peek_contiguous(&rx_queue, &rx_chars)) > 0) {
+        queue_commit(&rx_queue, rx_count);
+    }
+    frame_active = false;
+    deadline_queue_cancel(&deadlines, DEADLINE_FRAME_TIMEOUT);
+}
+
+bool start_pending_number(void) {
+    uint8_t record[2];
+
+    if (queue_dequeue_n(&pending_numbers, record, 2) < 2) {
+        return false; // Records are queued whole, so this means none are waiting
+    }
+    current_digit_idx = 0;
+    led_should_blink = false;
+    deadline_queue_cancel(&deadlines, DEADLINE_NEXT_DIGIT);
+    deadline_queue_cancel(&deadlines, DEADLINE_BLINK);
+    processed_number_len = (uint8_t)queue_dequeue_n(&pending_numbers, (uint8_t *)processed_number, record[1]);
+    processed_number[processed_number_len] = '\0';
+    continuous_mode_active = (record[0] & FRAME_FLAG_CONTINUOUS) != 0;
+    return true;
+}
+
 void reset_for_new_input(void) {
     input_buffer_idx = 0;
     input_buffer[0] = '\0';
@@ -392,8 +738,6 @@ void reset_for_new_input(void) {
     current_digit_idx = 0;
     led_should_blink = false;
     continuous_mode_active = false; // Ensure continuous mode is reset
-    uart_char_received_flag = false;
-    new_input_interrupt_flag = false;
-    uint8_t temp_char;
-    while(queue_dequeue(&rx_queue, &temp_char));
+    deadline_queue_cancel(&deadlines, DEADLINE_NEXT_DIGIT); // Stop analysis and blinking; a frame keeps its timeout
+    deadline_queue_cancel(&deadlines, DEADLINE_BLINK);
 }
\ No newline at end of file
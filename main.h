@@ -10,5 +10,11 @@
 #include "gpio.h"
 #include "leds.h"
 #include "queue.h"
+#include "event_queue.h"
+#include "deadline_queue.h"
+#include "cobs.h"
+#include "crc.h"
+#include "cycles.h"
+#include "log.h"
 
 #endif // MAIN_H
\ No newline at end of file
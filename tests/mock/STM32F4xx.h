@@ -0,0 +1,144 @@
+/*!
+ * \file      STM32F4xx.h
+ * \brief     Host stand-in for the CMSIS device header.
+ *
+ * Declares the peripherals the UART driver touches as plain structures
+ * in host memory (defined in mock_stm32f4xx.c), so a test can set
+ * status flags, run the driver and then inspect what it wrote to the
+ * registers. Only the registers and bits the drivers use are here.
+ * The layouts follow the reference manual; addresses do not matter.
+ *
+ * Interrupt masking is modelled by mock_primask, and the exception
+ * number by mock_ipsr, which a test sets while it calls a handler.
+ * __WFI() is left to the test, as the point where the code under test
+ * waits for it to raise an interrupt.
+ */
+#ifndef MOCK_STM32F4XX_H
+#define MOCK_STM32F4XX_H
+#include <stdint.h>
+
+#define __IO volatile
+#define __I  volatile const
+
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+typedef enum {
+	DMA1_Stream5_IRQn = 16,
+	DMA1_Stream6_IRQn = 17,
+	USART1_IRQn       = 37,
+	USART2_IRQn       = 38,
+	EXTI15_10_IRQn    = 40,
+	DMA2_Stream1_IRQn = 57,
+	DMA2_Stream2_IRQn = 58,
+	DMA2_Stream6_IRQn = 69,
+	DMA2_Stream7_IRQn = 70,
+	USART6_IRQn       = 71
+} IRQn_Type;
+
+typedef struct {
+	__IO uint16_t SR;   uint16_t RESERVED0;
+	__IO uint16_t DR;   uint16_t RESERVED1;
+	__IO uint16_t BRR;  uint16_t RESERVED2;
+	__IO uint16_t CR1;  uint16_t RESERVED3;
+	__IO uint16_t CR2;  uint16_t RESERVED4;
+	__IO uint16_t CR3;  uint16_t RESERVED5;
+	__IO uint16_t GTPR; uint16_t RESERVED6;
+} USART_TypeDef;
+
+typedef struct {
+	__IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR;
+	__IO uint16_t BSRRL, BSRRH;
+	__IO uint32_t LCKR;
+	__IO uint32_t AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+	__IO uint32_t LISR, HISR, LIFCR, HIFCR;
+} DMA_TypeDef;
+
+extern USART_TypeDef mock_USART1, mock_USART2, mock_USART6;
+extern GPIO_TypeDef mock_GPIOA, mock_GPIOB, mock_GPIOC;
+extern DMA_TypeDef mock_DMA1, mock_DMA2;
+extern DMA_Stream_TypeDef mock_DMA1_Stream5, mock_DMA1_Stream6;
+extern DMA_Stream_TypeDef mock_DMA2_Stream1, mock_DMA2_Stream2, mock_DMA2_Stream6, mock_DMA2_Stream7;
+extern uint32_t mock_primask;
+extern uint32_t mock_ipsr;
+
+#define USART1       (&mock_USART1)
+#define USART2       (&mock_USART2)
+#define USART6       (&mock_USART6)
+#define GPIOA        (&mock_GPIOA)
+#define GPIOB        (&mock_GPIOB)
+#define GPIOC        (&mock_GPIOC)
+#define DMA1         (&mock_DMA1)
+#define DMA2         (&mock_DMA2)
+#define DMA1_Stream5 (&mock_DMA1_Stream5)
+#define DMA1_Stream6 (&mock_DMA1_Stream6)
+#define DMA2_Stream1 (&mock_DMA2_Stream1)
+#define DMA2_Stream2 (&mock_DMA2_Stream2)
+#define DMA2_Stream6 (&mock_DMA2_Stream6)
+#define DMA2_Stream7 (&mock_DMA2_Stream7)
+
+#define FLASH_BASE 0x08000000UL
+
+#define READ_BIT(REG, BIT)  ((REG) & (BIT))
+#define SET_BIT(REG, BIT)   ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+
+#define USART_SR_PE      0x0001
+#define USART_SR_FE      0x0002
+#define USART_SR_NE      0x0004
+#define USART_SR_ORE     0x0008
+#define USART_SR_IDLE    0x0010
+#define USART_SR_RXNE    0x0020
+#define USART_SR_TC      0x0040
+#define USART_SR_TXE     0x0080
+#define USART_SR_LBD     0x0100
+#define USART_SR_CTS     0x0200
+
+#define USART_CR1_IDLEIE 0x0010
+#define USART_CR1_RXNEIE 0x0020
+#define USART_CR1_TCIE   0x0040
+#define USART_CR1_TXEIE  0x0080
+#define USART_CR1_PEIE   0x0100
+#define USART_CR1_OVER8  0x8000
+
+#define USART_CR3_EIE    0x0001
+#define USART_CR3_DMAR   0x0040
+#define USART_CR3_DMAT   0x0080
+
+#define DMA_SxCR_EN      0x00000001UL
+#define DMA_SxCR_TCIE    0x00000010UL
+#define DMA_SxCR_HTIE    0x00000008UL
+#define DMA_SxCR_DIR_0   0x00000040UL
+#define DMA_SxCR_CIRC    0x00000100UL
+#define DMA_SxCR_MINC    0x00000400UL
+#define DMA_SxCR_CHSEL_0 0x02000000UL
+#define DMA_SxCR_CHSEL_2 0x08000000UL
+
+#define DMA_LISR_FEIF0   0x00000001UL
+#define DMA_LISR_DMEIF0  0x00000004UL
+#define DMA_LISR_TEIF0   0x00000008UL
+#define DMA_LISR_HTIF0   0x00000010UL
+#define DMA_LISR_TCIF0   0x00000020UL
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+
+static inline void __enable_irq(void) { mock_primask = 0; }
+static inline void __disable_irq(void) { mock_primask = 1; }
+static inline uint32_t __get_PRIMASK(void) { return mock_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { mock_primask = primask; }
+static inline uint32_t __get_IPSR(void) { return mock_ipsr; }
+
+// Defined by a test that runs code which sleeps, to take control there.
+void __WFI(void);
+
+#endif // MOCK_STM32F4XX_H
@@ -0,0 +1,52 @@
+/*!
+ * \file      STM32F4xx_GPIO.h
+ * \brief     Host stand-in for the GPIO part of the standard
+ *            peripheral library: the subset the UART driver uses.
+ */
+#ifndef MOCK_STM32F4XX_GPIO_H
+#define MOCK_STM32F4XX_GPIO_H
+#include "STM32F4xx.h"
+
+typedef enum { GPIO_Mode_IN = 0x00, GPIO_Mode_OUT = 0x01, GPIO_Mode_AF = 0x02, GPIO_Mode_AN = 0x03 } GPIOMode_TypeDef;
+typedef enum { GPIO_OType_PP = 0x00, GPIO_OType_OD = 0x01 } GPIOOType_TypeDef;
+typedef enum { GPIO_Speed_2MHz = 0x00, GPIO_Speed_25MHz = 0x01, GPIO_Speed_50MHz = 0x02, GPIO_Speed_100MHz = 0x03 } GPIOSpeed_TypeDef;
+typedef enum { GPIO_PuPd_NOPULL = 0x00, GPIO_PuPd_UP = 0x01, GPIO_PuPd_DOWN = 0x02 } GPIOPuPd_TypeDef;
+
+typedef struct {
+	uint32_t GPIO_Pin;
+	GPIOMode_TypeDef GPIO_Mode;
+	GPIOSpeed_TypeDef GPIO_Speed;
+	GPIOOType_TypeDef GPIO_OType;
+	GPIOPuPd_TypeDef GPIO_PuPd;
+} GPIO_InitTypeDef;
+
+#define GPIO_Pin_0       ((uint16_t)0x0001)
+#define GPIO_Pin_1       ((uint16_t)0x0002)
+#define GPIO_Pin_2       ((uint16_t)0x0004)
+#define GPIO_Pin_3       ((uint16_t)0x0008)
+#define GPIO_Pin_6       ((uint16_t)0x0040)
+#define GPIO_Pin_7       ((uint16_t)0x0080)
+#define GPIO_Pin_9       ((uint16_t)0x0200)
+#define GPIO_Pin_10      ((uint16_t)0x0400)
+#define GPIO_Pin_11      ((uint16_t)0x0800)
+#define GPIO_Pin_12      ((uint16_t)0x1000)
+
+#define GPIO_PinSource0  ((uint8_t)0x00)
+#define GPIO_PinSource2  ((uint8_t)0x02)
+#define GPIO_PinSource3  ((uint8_t)0x03)
+#define GPIO_PinSource6  ((uint8_t)0x06)
+#define GPIO_PinSource7  ((uint8_t)0x07)
+#define GPIO_PinSource9  ((uint8_t)0x09)
+#define GPIO_PinSource10 ((uint8_t)0x0A)
+#define GPIO_PinSource11 ((uint8_t)0x0B)
+
+#define GPIO_AF_USART1   ((uint8_t)0x07)
+#define GPIO_AF_USART2   ((uint8_t)0x07)
+#define GPIO_AF_USART6   ((uint8_t)0x08)
+
+void GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_InitStruct);
+void GPIO_PinAFConfig(GPIO_TypeDef* GPIOx, uint16_t GPIO_PinSource, uint8_t GPIO_AF);
+void GPIO_SetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void GPIO_ResetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+
+#endif // MOCK_STM32F4XX_GPIO_H
@@ -0,0 +1,31 @@
+/*!
+ * \file      STM32F4xx_RCC.h
+ * \brief     Host stand-in for the RCC part of the standard
+ *            peripheral library: the subset the UART driver uses.
+ */
+#ifndef MOCK_STM32F4XX_RCC_H
+#define MOCK_STM32F4XX_RCC_H
+#include "STM32F4xx.h"
+
+typedef struct {
+	uint32_t SYSCLK_Frequency;
+	uint32_t HCLK_Frequency;
+	uint32_t PCLK1_Frequency;
+	uint32_t PCLK2_Frequency;
+} RCC_ClocksTypeDef;
+
+#define RCC_AHB1Periph_GPIOA  ((uint32_t)0x00000001)
+#define RCC_AHB1Periph_GPIOB  ((uint32_t)0x00000002)
+#define RCC_AHB1Periph_GPIOC  ((uint32_t)0x00000004)
+#define RCC_AHB1Periph_DMA1   ((uint32_t)0x00200000)
+#define RCC_AHB1Periph_DMA2   ((uint32_t)0x00400000)
+#define RCC_APB1Periph_USART2 ((uint32_t)0x00020000)
+#define RCC_APB2Periph_USART1 ((uint32_t)0x00000010)
+#define RCC_APB2Periph_USART6 ((uint32_t)0x00000020)
+
+void RCC_GetClocksFreq(RCC_ClocksTypeDef* RCC_Clocks);
+void RCC_AHB1PeriphClockCmd(uint32_t RCC_AHB1Periph, FunctionalState NewState);
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState);
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState);
+
+#endif // MOCK_STM32F4XX_RCC_H
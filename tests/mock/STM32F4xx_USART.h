@@ -0,0 +1,37 @@
+/*!
+ * \file      STM32F4xx_USART.h
+ * \brief     Host stand-in for the USART part of the standard
+ *            peripheral library: the subset the UART driver uses.
+ */
+#ifndef MOCK_STM32F4XX_USART_H
+#define MOCK_STM32F4XX_USART_H
+#include "STM32F4xx.h"
+
+typedef struct {
+	uint32_t USART_BaudRate;
+	uint16_t USART_WordLength;
+	uint16_t USART_StopBits;
+	uint16_t USART_Parity;
+	uint16_t USART_Mode;
+	uint16_t USART_HardwareFlowControl;
+} USART_InitTypeDef;
+
+#define USART_WordLength_8b            ((uint16_t)0x0000)
+#define USART_StopBits_1               ((uint16_t)0x0000)
+#define USART_Parity_No                ((uint16_t)0x0000)
+#define USART_Mode_Rx                  ((uint16_t)0x0004)
+#define USART_Mode_Tx                  ((uint16_t)0x0008)
+#define USART_HardwareFlowControl_None ((uint16_t)0x0000)
+#define USART_HardwareFlowControl_CTS  ((uint16_t)0x0200)
+
+#define USART_FLAG_TXE                 ((uint16_t)0x0080)
+#define USART_FLAG_TC                  ((uint16_t)0x0040)
+#define USART_FLAG_RXNE                ((uint16_t)0x0020)
+
+void USART_Init(USART_TypeDef* USARTx, USART_InitTypeDef* USART_InitStruct);
+void USART_Cmd(USART_TypeDef* USARTx, FunctionalState NewState);
+void USART_SendData(USART_TypeDef* USARTx, uint16_t Data);
+uint16_t USART_ReceiveData(USART_TypeDef* USARTx);
+FlagStatus USART_GetFlagStatus(USART_TypeDef* USARTx, uint16_t USART_FLAG);
+
+#endif // MOCK_STM32F4XX_USART_H
@@ -0,0 +1,94 @@
+// Register blocks and library functions behind the host stand-ins in
+// this directory. Library calls only record what a test may want to
+// check; the registers are left for the driver and the test to drive.
+#include "STM32F4xx.h"
+#include "STM32F4xx_RCC.h"
+#include "STM32F4xx_USART.h"
+#include "STM32F4xx_GPIO.h"
+
+USART_TypeDef mock_USART1, mock_USART2, mock_USART6;
+GPIO_TypeDef mock_GPIOA, mock_GPIOB, mock_GPIOC;
+DMA_TypeDef mock_DMA1, mock_DMA2;
+DMA_Stream_TypeDef mock_DMA1_Stream5, mock_DMA1_Stream6;
+DMA_Stream_TypeDef mock_DMA2_Stream1, mock_DMA2_Stream2, mock_DMA2_Stream6, mock_DMA2_Stream7;
+uint32_t mock_primask;
+uint32_t mock_ipsr;
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {
+	(void)irq;
+	(void)priority;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq) {
+	(void)irq;
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq) {
+	(void)irq;
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq) {
+	(void)irq;
+}
+
+void RCC_GetClocksFreq(RCC_ClocksTypeDef* RCC_Clocks) {
+	RCC_Clocks->SYSCLK_Frequency = 16000000;
+	RCC_Clocks->HCLK_Frequency = 16000000;
+	RCC_Clocks->PCLK1_Frequency = 16000000;
+	RCC_Clocks->PCLK2_Frequency = 16000000;
+}
+
+void RCC_AHB1PeriphClockCmd(uint32_t RCC_AHB1Periph, FunctionalState NewState) {
+	(void)RCC_AHB1Periph;
+	(void)NewState;
+}
+
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState) {
+	(void)RCC_APB1Periph;
+	(void)NewState;
+}
+
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState) {
+	(void)RCC_APB2Periph;
+	(void)NewState;
+}
+
+void GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_InitStruct) {
+	(void)GPIOx;
+	(void)GPIO_InitStruct;
+}
+
+void GPIO_PinAFConfig(GPIO_TypeDef* GPIOx, uint16_t GPIO_PinSource, uint8_t GPIO_AF) {
+	(void)GPIOx;
+	(void)GPIO_PinSource;
+	(void)GPIO_AF;
+}
+
+void GPIO_SetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+	GPIOx->ODR |= GPIO_Pin;
+}
+
+void GPIO_ResetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+	GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+}
+
+void USART_Init(USART_TypeDef* USARTx, USART_InitTypeDef* USART_InitStruct) {
+	USARTx->CR1 |= USART_InitStruct->USART_Mode;
+}
+
+void USART_Cmd(USART_TypeDef* USARTx, FunctionalState NewState) {
+	(void)USARTx;
+	(void)NewState;
+}
+
+void USART_SendData(USART_TypeDef* USARTx, uint16_t Data) {
+	USARTx->DR = Data;
+}
+
+uint16_t USART_ReceiveData(USART_TypeDef* USARTx) {
+	return USARTx->DR;
+}
+
+FlagStatus USART_GetFlagStatus(USART_TypeDef* USARTx, uint16_t USART_FLAG) {
+	return (USARTx->SR & USART_FLAG) ? SET : RESET;
+}
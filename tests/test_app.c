@@ -0,0 +1,372 @@
+/*!
+ * \file      test_app.c
+ * \brief     Scripted test of the application in main.c on mocked hardware.
+ *
+ * main.c is compiled into this file with its main() renamed, and runs
+ * on a thread of its own against the UART, queue and log drivers built
+ * on the register stand-ins in mock/. The timer, GPIO, LED, CRC and
+ * cycle counter drivers are replaced by the stand-ins below.
+ *
+ * The application and the test take turns. The application runs until
+ * its main loop sleeps in __WFI(); the test then plays the hardware:
+ * it delivers received bytes through the USART2 receive DMA buffer and
+ * the line-idle interrupt, advances the 1 ms tick, and completes the
+ * DMA transfers that carry the output to a transcript, before letting
+ * the application run again. The checks are made on the transcript
+ * and on the LED.
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define main app_main
+#include "../main.c"
+#undef main
+
+void USART2_IRQHandler(void);
+void DMA1_Stream6_IRQHandler(void);
+
+// Stand-ins for the drivers that touch hardware the mock does not model.
+
+static void (*tick_callback)(void);
+static int tick_enabled;
+static uint32_t clock_ms; // TIM5, which counts whether or not the tick is enabled
+static int led_on;
+static uint32_t led_changes;
+static uint32_t cycle_count;
+
+void timer_init(uint32_t timestamp) {
+	(void)timestamp;
+}
+
+void timer_set_callback(void (*callback)(void)) {
+	tick_callback = callback;
+}
+
+void timer_enable(void) {
+	tick_enabled = 1;
+}
+
+void timer_disable(void) {
+	tick_enabled = 0;
+}
+
+const volatile uint32_t *timer_ms_clock_init(void) {
+	return &clock_ms;
+}
+
+void gpio_set_mode(Pin pin, PinMode mode) {
+	(void)pin;
+	(void)mode;
+}
+
+void gpio_set_trigger(Pin pin, TriggerMode trig) {
+	(void)pin;
+	(void)trig;
+}
+
+void gpio_set_callback(Pin pin, void (*callback)(int status)) {
+	(void)pin;
+	(void)callback;
+}
+
+void leds_init(void) {
+}
+
+void leds_set(int red_on, int green_on, int blue_on) {
+	(void)green_on;
+	(void)blue_on;
+	if (red_on != led_on) {
+		led_changes++;
+	}
+	led_on = red_on;
+}
+
+void crc_init(void) {
+}
+
+// The CRC unit's CRC-32: polynomial 0x04C11DB7, most significant bit
+// first, over 32-bit words loaded little-endian, the last one padded
+// with zeros as crc.c does.
+uint32_t crc_compute(const uint8_t *data, uint32_t len) {
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t i;
+	int bit;
+
+	for (i = 0; i < len; i += 4) {
+		uint32_t word = 0;
+		uint32_t j;
+
+		for (j = 0; j < 4 && i + j < len; j++) {
+			word |= (uint32_t)data[i + j] << (8 * j);
+		}
+		crc ^= word;
+		for (bit = 0; bit < 32; bit++) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+void cycles_init(void) {
+	cycle_count = 0;
+}
+
+uint32_t cycles_now(void) {
+	return cycle_count += 100;
+}
+
+uint32_t cycles_to_ns(uint32_t cycles) {
+	return cycles * 1000 / 16; // At the 16 MHz of the mocked clock
+}
+
+// Turn taking between the application and the test.
+
+static sem_t app_turn;
+static sem_t test_turn;
+static char transcript[65536]; // Everything the application has sent
+static uint32_t transcript_length;
+static uint32_t checked;       // The transcript up to here has been matched
+
+void __WFI(void) {
+	sem_post(&test_turn);
+	sem_wait(&app_turn);
+}
+
+static void *app_thread(void *arg) {
+	(void)arg;
+	app_main();
+	return 0;
+}
+
+static void interrupt(int exception, void (*handler)(void)) {
+	mock_ipsr = exception;
+	handler();
+	mock_ipsr = 0;
+}
+
+// Completes DMA transfers until the application has nothing left to send.
+static void send_output(void) {
+	while (DMA1_Stream6->CR & DMA_SxCR_EN) {
+		uint32_t length = DMA1_Stream6->NDTR;
+
+		if (transcript_length + length >= sizeof(transcript)) {
+			fprintf(stderr, "test_app: transcript full\n");
+			exit(1);
+		}
+		memcpy(transcript + transcript_length, (const void *)(uintptr_t)DMA1_Stream6->M0AR, length);
+		transcript_length += length;
+		DMA1_Stream6->CR &= ~DMA_SxCR_EN;
+		DMA1_Stream6->NDTR = 0;
+		USART2->SR |= USART_SR_TXE | USART_SR_TC;
+		DMA1->HISR |= DMA_LISR_TCIF0 << 16; // Stream 6 flags start at bit 16
+		interrupt(DMA1_Stream6_IRQn + 16, DMA1_Stream6_IRQHandler);
+		DMA1->HISR = 0;
+	}
+	transcript[transcript_length] = '\0';
+}
+
+// Lets the application run until it sleeps again, and sends its output.
+static void run(void) {
+	sem_post(&app_turn);
+	sem_wait(&test_turn);
+	send_output();
+}
+
+// Receives bytes as the DMA stream and the line-idle interrupt would,
+// a few at a time, with the error flags \a errors set with the last.
+static void receive(const uint8_t *data, uint32_t len, uint16_t errors) {
+	uint8_t *buffer = (uint8_t *)(uintptr_t)DMA1_Stream5->M0AR;
+
+	while (len > 0) {
+		uint32_t piece = len < 16 ? len : 16;
+		uint32_t i;
+
+		for (i = 0; i < piece; i++) {
+			buffer[UART_RX_DMA_BUFFER_SIZE - DMA1_Stream5->NDTR] = data[i];
+			if (--DMA1_Stream5->NDTR == 0) {
+				DMA1_Stream5->NDTR = UART_RX_DMA_BUFFER_SIZE; // Circular
+			}
+		}
+		data += piece;
+		len -= piece;
+		// The driver clears TC by writing zero to it and ones elsewhere,
+		// which the plain memory of the mock keeps; only the transmit
+		// flags are carried over.
+		USART2->SR = (USART2->SR & (USART_SR_TXE | USART_SR_TC)) | USART_SR_IDLE | (len == 0 ? errors : 0);
+		interrupt(USART2_IRQn + 16, USART2_IRQHandler);
+		USART2->SR &= USART_SR_TXE | USART_SR_TC;
+		run();
+	}
+}
+
+static void type(const char *text) {
+	receive((const uint8_t *)text, strlen(text), 0);
+}
+
+// Sends a binary frame holding one number record.
+static void send_frame(uint8_t flags, const char *digits) {
+	uint8_t payload[BUFF_SIZE + 2 + FRAME_CRC_SIZE];
+	uint8_t frame[COBS_ENCODED_SIZE(sizeof(payload)) + 2];
+	uint32_t len = strlen(digits);
+	uint32_t crc;
+	uint32_t encoded;
+
+	payload[0] = flags;
+	payload[1] = (uint8_t)len;
+	memcpy(payload + 2, digits, len);
+	crc = crc_compute(payload, len + 2);
+	payload[len + 2] = (uint8_t)crc;
+	payload[len + 3] = (uint8_t)(crc >> 8);
+	payload[len + 4] = (uint8_t)(crc >> 16);
+	payload[len + 5] = (uint8_t)(crc >> 24);
+	frame[0] = 0x00;
+	encoded = cobs_encode(payload, len + 2 + FRAME_CRC_SIZE, frame + 1);
+	frame[encoded + 1] = 0x00;
+	receive(frame, encoded + 2, 0);
+}
+
+// Advances time, running the application on each tick while the
+// timer is enabled.
+static void wait_ms(uint32_t ms) {
+	while (ms-- > 0) {
+		clock_ms++;
+		if (tick_enabled) {
+			interrupt(15, tick_callback); // SysTick
+			run();
+		}
+	}
+}
+
+// Checks that \a text was sent after whatever the last check matched.
+static int expect(const char *test, const char *text) {
+	const char *found = strstr(transcript + checked, text);
+
+	if (found == 0) {
+		fprintf(stderr, "test_app: %s: \"%s\" was not sent. Sent since the last match:\n%s\n",
+		        test, text, transcript + checked);
+		return 0;
+	}
+	checked = (uint32_t)(found - transcript) + strlen(text);
+	return 1;
+}
+
+static int fail(const char *test, const char *what) {
+	fprintf(stderr, "test_app: %s: %s\n", test, what);
+	return 0;
+}
+
+// A frame that arrives while the LED blinks after an even last digit
+// must still be analysed: nothing else moves the state machine on.
+static int test_frame_while_blinking(void) {
+	const char *test = "frame while blinking";
+	uint32_t changes;
+
+	type("2\r");
+	wait_ms(DIGIT_ANALYSIS_INTERVAL_MS + 100);
+	if (!expect(test, "Continuous LED blinking.") ||
+	    current_app_state != APP_STATE_CONTINUOUS_BLINK) {
+		return fail(test, "an even digit did not leave the LED blinking");
+	}
+	send_frame(0, "13");
+	wait_ms(2 * DIGIT_ANALYSIS_INTERVAL_MS + 100);
+	if (!expect(test, "Frame accepted: 1 numbers queued.") ||
+	    !expect(test, "Analyzing digit 1 (1)") ||
+	    !expect(test, "Analyzing digit 3 (3)") ||
+	    !expect(test, "Analysis complete.")) {
+		return 0;
+	}
+	changes = led_changes;
+	wait_ms(1000);
+	if (led_changes != changes) {
+		return fail(test, "LED still blinking after the queued number");
+	}
+	return 1;
+}
+
+// A line without digits is refused with a fresh prompt, as a log
+// command is answered with one.
+static int test_line_without_digits(void) {
+	const char *test = "line without digits";
+
+	type("abc\r");
+	if (!expect(test, "No valid digits entered.") || !expect(test, "Enter number: ")) {
+		return 0;
+	}
+	type("log 4\r");
+	if (!expect(test, "Log level 4") || !expect(test, "Enter number: ")) {
+		return 0;
+	}
+	return 1;
+}
+
+// A lone 0x00 suspends typing for a frame that never comes. The frame
+// is given up after FRAME_TIMEOUT_MS and typed text is taken again.
+static int test_lone_zero(void) {
+	const char *test = "lone zero";
+	static const uint8_t zero = 0x00;
+
+	receive(&zero, 1, 0);
+	wait_ms(FRAME_TIMEOUT_MS + 10);
+	if (!expect(test, "Frame dropped: timed out.")) {
+		return 0;
+	}
+	type("7\r");
+	wait_ms(DIGIT_ANALYSIS_INTERVAL_MS + 10);
+	return expect(test, "Analyzing digit 7 (7)") && expect(test, "Analysis complete.");
+}
+
+// A receive error in binary data drops the frame at once.
+static int test_error_in_frame(void) {
+	const char *test = "error in frame";
+	static const uint8_t data[] = { 0x00, 0x03, '1' };
+
+	receive(data, sizeof(data), USART_SR_FE);
+	if (!expect(test, "Frame dropped: receive error.")) {
+		return 0;
+	}
+	type("3\r");
+	wait_ms(DIGIT_ANALYSIS_INTERVAL_MS + 10);
+	return expect(test, "Analyzing digit 3 (3)") && expect(test, "Analysis complete.");
+}
+
+// Binary data longer than any frame is dropped as soon as it outgrows
+// the frame buffer; what follows is taken as typed.
+static int test_frame_too_long(void) {
+	const char *test = "frame too long";
+	uint8_t data[1 + FRAME_BUFFER_SIZE + 16];
+
+	memset(data, 'x', sizeof(data));
+	data[0] = 0x00;
+	receive(data, sizeof(data), 0);
+	if (!expect(test, "Frame rejected: too long.")) {
+		return 0;
+	}
+	type("\r5\r");
+	wait_ms(DIGIT_ANALYSIS_INTERVAL_MS + 10);
+	return expect(test, "Analyzing digit 5 (5)") && expect(test, "Analysis complete.");
+}
+
+int main(void) {
+	pthread_t thread;
+
+	sem_init(&app_turn, 0, 0);
+	sem_init(&test_turn, 0, 0);
+	if (pthread_create(&thread, 0, app_thread, 0) != 0) {
+		fprintf(stderr, "test_app: pthread_create failed\n");
+		return 1;
+	}
+	sem_wait(&test_turn);
+	send_output();
+	if (!expect("start", "Enter number: ")) {
+		return 1;
+	}
+
+	if (!test_frame_while_blinking() || !test_line_without_digits() ||
+	    !test_lone_zero() || !test_error_in_frame() || !test_frame_too_long()) {
+		return 1;
+	}
+	printf("test_app: the application handles input as scripted\n");
+	return 0; // The application thread is left asleep in __WFI()
+}
@@ -0,0 +1,167 @@
+/*!
+ * \file      test_deadline_queue.c
+ * \brief     Randomized test of the deadline queue against a reference model.
+ *
+ * A long random sequence of inserts, cancels, pops and clock ticks is
+ * applied both to a deadline queue and to a plain unordered array that
+ * is searched linearly. After every step the two must agree on the
+ * number of entries, the earliest deadline and whether it is due, and
+ * every pop must return an event the model holds at that deadline.
+ *
+ * Each run starts the clock at a different point, including just
+ * before 2^31 and 2^32, so deadlines are compared across both the
+ * signed and the unsigned wrap of the counter.
+ *
+ * DEADLINE_STEPS sets the number of operations per run.
+ */
+#include "deadline_queue.h"
+#include <stdio.h>
+
+#ifndef DEADLINE_STEPS
+#define DEADLINE_STEPS 2000000
+#endif
+
+#define QUEUE_SIZE 32
+#define EVENTS     16 // Few distinct events, so cancels hit several entries
+
+DEADLINE_QUEUE_DEFINE(queue, QUEUE_SIZE);
+
+static DeadlineEntry model[QUEUE_SIZE];
+static uint32_t model_count;
+
+static uint32_t random_state = 0x2545F491;
+
+static uint32_t random_next(void) {
+	uint32_t x = random_state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	random_state = x;
+	return x;
+}
+
+static int before(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) < 0;
+}
+
+// Index of an earliest entry in the model, or -1 if it is empty.
+static int model_earliest(void) {
+	int earliest = -1;
+	uint32_t i;
+
+	for (i = 0; i < model_count; i++) {
+		if (earliest < 0 || before(model[i].deadline, model[earliest].deadline)) {
+			earliest = (int)i;
+		}
+	}
+	return earliest;
+}
+
+static void model_remove(uint32_t i) {
+	model[i] = model[--model_count];
+}
+
+static int fail(uint32_t start, uint32_t step, const char *what) {
+	fprintf(stderr, "test_deadline_queue: clock from 0x%08X, step %u: %s\n",
+	        (unsigned)start, (unsigned)step, what);
+	return 0;
+}
+
+static int run(uint32_t start) {
+	uint32_t now = start;
+	uint32_t step;
+
+	deadline_queue_clear(&queue);
+	model_count = 0;
+
+	for (step = 0; step < DEADLINE_STEPS; step++) {
+		uint32_t choice = random_next() % 100;
+		const DeadlineEntry *first;
+		int earliest;
+
+		if (choice < 40) {
+			// Mostly future deadlines, some already overdue
+			uint32_t deadline = now + random_next() % 2000 - 200;
+			uint32_t event = random_next() % EVENTS;
+			int inserted = deadline_queue_insert(&queue, deadline, event);
+
+			if (inserted != (model_count < QUEUE_SIZE)) {
+				return fail(start, step, "insert disagrees about a full queue");
+			}
+			if (inserted) {
+				model[model_count].deadline = deadline;
+				model[model_count].event = event;
+				model_count++;
+			}
+		} else if (choice < 48) {
+			uint32_t event = random_next() % EVENTS;
+			uint32_t removed = 0;
+			uint32_t i;
+
+			for (i = model_count; i-- > 0;) {
+				if (model[i].event == event) {
+					model_remove(i);
+					removed++;
+				}
+			}
+			if (deadline_queue_cancel(&queue, event) != removed) {
+				return fail(start, step, "cancel removed the wrong number of entries");
+			}
+		} else if (choice < 78) {
+			uint32_t event;
+			int popped = deadline_queue_pop_due(&queue, now, &event);
+
+			earliest = model_earliest();
+			if (popped != (earliest >= 0 && !before(now, model[earliest].deadline))) {
+				return fail(start, step, "pop disagrees about a due entry");
+			}
+			if (popped) {
+				// Entries with equal deadlines may come out in any order.
+				uint32_t i;
+
+				for (i = 0; i < model_count; i++) {
+					if (model[i].deadline == model[earliest].deadline && model[i].event == event) {
+						break;
+					}
+				}
+				if (i == model_count) {
+					return fail(start, step, "pop returned an event that is not due first");
+				}
+				model_remove(i);
+			}
+		} else if (choice < 99) {
+			now += random_next() % 100;
+		} else if (random_next() % 100 == 0) {
+			deadline_queue_clear(&queue);
+			model_count = 0;
+		}
+
+		first = deadline_queue_peek(&queue);
+		earliest = model_earliest();
+		if ((first == 0) != (earliest < 0)) {
+			return fail(start, step, "peek disagrees about an empty queue");
+		}
+		if (first != 0 && first->deadline != model[earliest].deadline) {
+			return fail(start, step, "peek returned the wrong deadline");
+		}
+		if (deadline_queue_is_due(&queue, now) != (earliest >= 0 && !before(now, model[earliest].deadline))) {
+			return fail(start, step, "is_due disagrees with the model");
+		}
+	}
+	return 1;
+}
+
+int main(void) {
+	static const uint32_t starts[] = { 0, 0x7FFFF000, 0xFFFFF000 };
+	uint32_t i;
+
+	for (i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+		if (!run(starts[i])) {
+			return 1;
+		}
+	}
+	printf("test_deadline_queue: %u random operations from %u clock start points agree with the model\n",
+	       (unsigned)(DEADLINE_STEPS * i), (unsigned)i);
+	return 0;
+}
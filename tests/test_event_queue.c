@@ -0,0 +1,191 @@
+/*!
+ * \file      test_event_queue.c
+ * \brief     Four-producer model test of the event queue.
+ *
+ * Four producer threads stand in for interrupt handlers at different
+ * priorities and post numbered events to one queue while the main
+ * thread takes them off. On the host the claim loop uses a
+ * compare-and-swap where the target uses LDREX/STREX; the slot
+ * publication is the same code.
+ *
+ * In the normal mode every event must arrive exactly once, and the
+ * events of each producer must arrive in the order they were posted.
+ * In overwrite mode events may be lost, but each one that arrives must
+ * be intact and newer than the last from the same producer, and the
+ * events received plus those reported missed must add up to the
+ * events posted.
+ *
+ * EVENTS_PER_PRODUCER sets the length of each run.
+ */
+#include "event_queue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#ifndef EVENTS_PER_PRODUCER
+#define EVENTS_PER_PRODUCER 2000000
+#endif
+
+#define PRODUCERS 4
+
+typedef struct {
+	uint32_t producer; // Which thread posted the event
+	uint32_t number;   // Position in that thread's sequence
+	uint32_t check;    // Derived from the two above, to catch torn copies
+} TestEvent;
+
+EVENT_QUEUE_DEFINE(fifo, TestEvent, 16);
+EVENT_QUEUE_DEFINE(log_queue, TestEvent, 16);
+
+static uint32_t producer_ids[PRODUCERS];
+static uint32_t producers_done;
+
+static uint32_t event_check(uint32_t producer, uint32_t number) {
+	return (number * 0x9E3779B1u) ^ (producer * 0x85EBCA77u) ^ 0xA5A5A5A5u;
+}
+
+static void *fifo_producer(void *arg) {
+	uint32_t producer = *(uint32_t*)arg;
+	TestEvent event;
+	uint32_t n;
+
+	for (n = 0; n < EVENTS_PER_PRODUCER; n++) {
+		event.producer = producer;
+		event.number = n;
+		event.check = event_check(producer, n);
+		while (!event_queue_post(&fifo, &event)) {
+			sched_yield();
+		}
+	}
+	return 0;
+}
+
+static void *overwrite_producer(void *arg) {
+	uint32_t producer = *(uint32_t*)arg;
+	TestEvent event;
+	uint32_t n;
+
+	for (n = 0; n < EVENTS_PER_PRODUCER; n++) {
+		event.producer = producer;
+		event.number = n;
+		event.check = event_check(producer, n);
+		event_queue_post_overwrite(&log_queue, &event);
+		if ((n & 63) == 0) {
+			sched_yield(); // Give the reader a chance to keep up now and then
+		}
+	}
+	__atomic_fetch_add(&producers_done, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int start_producers(pthread_t *threads, void *(*body)(void*)) {
+	uint32_t i;
+
+	for (i = 0; i < PRODUCERS; i++) {
+		producer_ids[i] = i;
+		if (pthread_create(&threads[i], 0, body, &producer_ids[i]) != 0) {
+			fprintf(stderr, "test_event_queue: pthread_create failed\n");
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int valid_event(const TestEvent *event) {
+	if (event->producer >= PRODUCERS || event->check != event_check(event->producer, event->number)) {
+		fprintf(stderr, "test_event_queue: corrupt event %u/%u/%08X\n",
+		        (unsigned)event->producer, (unsigned)event->number, (unsigned)event->check);
+		return 0;
+	}
+	return 1;
+}
+
+static int test_fifo(void) {
+	pthread_t threads[PRODUCERS];
+	uint32_t expected[PRODUCERS] = { 0 };
+	uint32_t received = 0;
+	TestEvent event;
+	uint32_t i;
+
+	if (!start_producers(threads, fifo_producer)) {
+		return 0;
+	}
+	while (received < PRODUCERS * EVENTS_PER_PRODUCER) {
+		if (!event_queue_get(&fifo, &event)) {
+			sched_yield();
+			continue;
+		}
+		if (!valid_event(&event)) {
+			return 0;
+		}
+		if (event.number != expected[event.producer]) {
+			fprintf(stderr, "test_event_queue: producer %u event %u arrived, expected %u\n",
+			        (unsigned)event.producer, (unsigned)event.number, (unsigned)expected[event.producer]);
+			return 0;
+		}
+		expected[event.producer]++;
+		received++;
+	}
+	for (i = 0; i < PRODUCERS; i++) {
+		pthread_join(threads[i], 0);
+	}
+	if (event_queue_get(&fifo, &event)) {
+		fprintf(stderr, "test_event_queue: extra event after the last one\n");
+		return 0;
+	}
+	printf("test_event_queue: %u events from %u producers, all in order, none lost\n",
+	       (unsigned)received, (unsigned)PRODUCERS);
+	return 1;
+}
+
+static int test_overwrite(void) {
+	pthread_t threads[PRODUCERS];
+	uint32_t next[PRODUCERS] = { 0 };
+	uint32_t received = 0;
+	uint32_t missed = 0;
+	TestEvent event;
+	uint32_t i;
+
+	if (!start_producers(threads, overwrite_producer)) {
+		return 0;
+	}
+	// Keep reading while the producers run, then drain what is left.
+	for (;;) {
+		int done = __atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) == PRODUCERS;
+
+		if (event_queue_get_overwrite(&log_queue, &event, &missed)) {
+			if (!valid_event(&event)) {
+				return 0;
+			}
+			if (event.number < next[event.producer]) {
+				fprintf(stderr, "test_event_queue: producer %u event %u arrived after %u\n",
+				        (unsigned)event.producer, (unsigned)event.number, (unsigned)next[event.producer] - 1);
+				return 0;
+			}
+			next[event.producer] = event.number + 1;
+			received++;
+		} else if (done) {
+			break;
+		} else {
+			sched_yield();
+		}
+	}
+	for (i = 0; i < PRODUCERS; i++) {
+		pthread_join(threads[i], 0);
+	}
+	if (received + missed != PRODUCERS * EVENTS_PER_PRODUCER) {
+		fprintf(stderr, "test_event_queue: %u received + %u missed != %u posted\n",
+		        (unsigned)received, (unsigned)missed, (unsigned)(PRODUCERS * EVENTS_PER_PRODUCER));
+		return 0;
+	}
+	printf("test_event_queue: overwrite mode received %u and missed %u of %u events\n",
+	       (unsigned)received, (unsigned)missed, (unsigned)(PRODUCERS * EVENTS_PER_PRODUCER));
+	return 1;
+}
+
+int main(void) {
+	if (!test_fifo() || !test_overwrite()) {
+		return 1;
+	}
+	return 0;
+}
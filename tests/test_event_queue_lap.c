@@ -0,0 +1,188 @@
+/*!
+ * \file      test_event_queue_lap.c
+ * \brief     Deterministic interleavings of the event queue's overwrite mode.
+ *
+ * The threaded test in test_event_queue.c almost never preempts a
+ * writer between claiming a slot and publishing it, so the cases here
+ * are set up by hand. event_queue.c is compiled into this file with
+ * memcpy() replaced by preempting_memcpy(), which can run a handler
+ * halfway through a copy into the queue, the way a higher priority
+ * interrupt would interrupt a writer on the target.
+ *
+ * In every case the events returned must be intact and in the order
+ * posted, the reader must never stall while events are waiting, and
+ * the events received plus those reported missed must add up to the
+ * events posted.
+ */
+#include <stdio.h>
+#include <string.h>
+
+static void *preempting_memcpy(void *dst, const void *src, size_t n);
+#define memcpy preempting_memcpy
+#include "event_queue.c"
+#undef memcpy
+
+#define LAP_QUEUE_SIZE 4
+#define MAX_EVENTS     64
+
+typedef struct {
+	uint32_t number; // Position in the sequence posted by the test
+	uint32_t check;  // Derived from number, to catch a mixture of two events
+} LapEvent;
+
+EVENT_QUEUE_DEFINE(lap_queue, LapEvent, LAP_QUEUE_SIZE);
+
+static void (*interrupt)(void); // Run once, halfway through the next copy into a slot
+static uint32_t posted;
+static uint32_t received[MAX_EVENTS];
+static uint32_t received_count;
+static uint32_t missed;
+
+static void *preempting_memcpy(void *dst, const void *src, size_t n) {
+	uint8_t *d = (uint8_t*)dst;
+	const uint8_t *s = (const uint8_t*)src;
+
+	if (interrupt != 0 && d >= (uint8_t*)lap_queue_data && d < (uint8_t*)(lap_queue_data + LAP_QUEUE_SIZE)) {
+		void (*handler)(void) = interrupt;
+
+		interrupt = 0;
+		memcpy(d, s, n / 2);
+		handler();
+		memcpy(d + n / 2, s + n / 2, n - n / 2);
+		return dst;
+	}
+	return memcpy(dst, src, n);
+}
+
+static uint32_t event_check(uint32_t number) {
+	return (number * 0x9E3779B1u) ^ 0xA5A5A5A5u;
+}
+
+static void post(void) {
+	LapEvent event = { posted, event_check(posted) };
+
+	posted++;
+	event_queue_post_overwrite(&lap_queue, &event);
+}
+
+static void post_lap(void) {
+	uint32_t i;
+
+	for (i = 0; i <= LAP_QUEUE_SIZE; i++) {
+		post();
+	}
+}
+
+static void drain(void) {
+	LapEvent event;
+
+	while (event_queue_get_overwrite(&lap_queue, &event, &missed)) {
+		if (event.check != event_check(event.number)) {
+			fprintf(stderr, "test_event_queue_lap: event %u is a mixture of two events\n",
+			        (unsigned)event.number);
+			received[received_count++] = 0xFFFFFFFF;
+			continue;
+		}
+		received[received_count++] = event.number;
+	}
+}
+
+// Starts a case with the queue empty at \a position.
+static void start(uint32_t position) {
+	event_queue_init(&lap_queue, lap_queue_data, lap_queue_seq, sizeof(LapEvent), LAP_QUEUE_SIZE);
+	lap_queue.head = position;
+	lap_queue.tail = position;
+	interrupt = 0;
+	posted = 0;
+	received_count = 0;
+	missed = 0;
+}
+
+// Checks the outcome of a case against the numbers that should have
+// been received, which are all of the last ones posted.
+static int expect(const char *name, const uint32_t *numbers, uint32_t count) {
+	uint32_t i;
+
+	drain();
+	if (received_count != count) {
+		fprintf(stderr, "test_event_queue_lap: %s: received %u events, expected %u\n",
+		        name, (unsigned)received_count, (unsigned)count);
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		if (received[i] != numbers[i]) {
+			fprintf(stderr, "test_event_queue_lap: %s: event %u is %u, expected %u\n",
+			        name, (unsigned)i, (unsigned)received[i], (unsigned)numbers[i]);
+			return 0;
+		}
+	}
+	if (received_count + missed != posted) {
+		fprintf(stderr, "test_event_queue_lap: %s: %u received + %u missed != %u posted\n",
+		        name, (unsigned)received_count, (unsigned)missed, (unsigned)posted);
+		return 0;
+	}
+	return 1;
+}
+
+// A writer is interrupted mid-copy by writers that lap it. Its slot
+// now belongs to a newer event, which the rest of its copy spoils; the
+// reader must skip that slot and still get the event after it.
+static int test_lapped_writer(uint32_t position) {
+	static const uint32_t numbers[] = { 2, 3, 5 };
+
+	start(position);
+	interrupt = post_lap;
+	post();
+	return expect("lapped writer", numbers, 3);
+}
+
+// The reader gets to a slot whose writer has claimed it but not
+// finished, as it can from another thread. It must not return the half
+// written event, including at the position where the count wraps.
+static int test_unfinished_write(uint32_t position) {
+	static const uint32_t numbers[] = { 1, 2 };
+
+	start(position);
+	interrupt = drain;
+	post();
+	post();
+	post();
+	return expect("unfinished write", numbers, 2);
+}
+
+// Plain use across the wrap of the position counter: nothing is lost
+// while the reader keeps up, and a lap loses only the oldest events.
+static int test_wrap(uint32_t position) {
+	static const uint32_t numbers[] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+		30, 31, 32, 33
+	};
+	uint32_t i;
+
+	start(position);
+	for (i = 0; i < 24; i++) {
+		post();
+		if (i % 3 == 2) {
+			drain();
+		}
+	}
+	for (i = 0; i < 10; i++) {
+		post();
+	}
+	return expect("wrap", numbers, sizeof(numbers) / sizeof(numbers[0]));
+}
+
+int main(void) {
+	static const uint32_t starts[] = { 0, 0x7FFFFFFE, 0xFFFFFFF0, 0xFFFFFFFF };
+	uint32_t i;
+
+	for (i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+		if (!test_lapped_writer(starts[i]) || !test_unfinished_write(starts[i]) || !test_wrap(starts[i])) {
+			fprintf(stderr, "test_event_queue_lap: with the queue starting at position 0x%08X\n",
+			        (unsigned)starts[i]);
+			return 1;
+		}
+	}
+	printf("test_event_queue_lap: lapped and unfinished writers are skipped and counted, across the wrap\n");
+	return 0;
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Tests that tools/logdecode.py recovers from cut records and numbers
+messages as log.c does.
+
+Records are built the way log_record() builds them, around messages
+given directly rather than read from an .axf file. A record cut short
+by the UART, or the tail of one seen when the capture starts part way
+through, must cost at most that record: the text and records after it
+still decode.
+
+Message IDs are offsets in the log_messages section. They are checked
+against small ELF files laid out as armlink and GNU ld lay them out.
+"""
+import io
+import os
+import struct
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'tools'))
+import logdecode  # noqa: E402
+
+MESSAGES = {0x00: (3, 'Frame accepted: %lu numbers queued.\r\n'),
+            0xA6: (4, 'Analyzing digit %c (%d)...\r\n')}  # Two varint bytes
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index = 0
+    for byte in data:
+        if byte == 0:
+            out[code_index] = len(out) - code_index
+            code_index = len(out)
+            out.append(0)
+            continue
+        out.append(byte)
+        if len(out) - code_index == 0xFF:
+            out[code_index] = 0xFF
+            code_index = len(out)
+            out.append(0)
+    out[code_index] = len(out) - code_index
+    return bytes(out)
+
+
+def frame(message_id, delta, *args):
+    record = varint(message_id) + varint(delta) + b''.join(varint(a) for a in args)
+    return b'\x00' + cobs_encode(record) + b'\x00'
+
+
+def decode(stream, chunk_size=None):
+    out = io.StringIO()
+    if chunk_size is None:
+        chunks = [stream]
+    else:
+        chunks = [stream[i:i + chunk_size] for i in range(0, len(stream), chunk_size)]
+    logdecode.decode_stream(MESSAGES, chunks, out)
+    return out.getvalue()
+
+
+def elf(section_name, section_addr, contents, symbols):
+    """Writes an ELF32 file with one section of \a contents at
+    \a section_addr and a symbol table, returning its path."""
+    names = b'\0.shstrtab\0.symtab\0.strtab\0' + section_name.encode() + b'\0'
+    strtab = b'\0'
+    symtab = bytes(16)
+    for name, value in symbols:
+        symtab += struct.pack('<IIIBBH', len(strtab), value, 0, 0, 0, 4)
+        strtab += name.encode() + b'\0'
+    body = names + contents + symtab + strtab
+    shoff = 52 + len(body)
+    offsets = [52, 52 + len(names), 52 + len(names) + len(contents),
+               52 + len(names) + len(contents) + len(symtab)]
+    header = (b'\x7fELF\x01\x01\x01' + bytes(9) +
+              struct.pack('<HHIIIIIHHHHHH', 2, 40, 1, 0, 0, shoff, 0, 52, 0, 0, 40, 5, 1))
+    sections = bytes(40)
+    sections += struct.pack('<IIIIIIIIII', 1, 3, 0, 0, offsets[0], len(names), 0, 0, 1, 0)
+    sections += struct.pack('<IIIIIIIIII', 11, 2, 0, 0, offsets[2], len(symtab), 3, 1, 4, 16)
+    sections += struct.pack('<IIIIIIIIII', 19, 3, 0, 0, offsets[3], len(strtab), 0, 0, 1, 0)
+    sections += struct.pack('<IIIIIIIIII', 27, 1, 2, section_addr, offsets[1], len(contents), 0, 0, 1, 0)
+    handle, path = tempfile.mkstemp(suffix='.axf')
+    with os.fdopen(handle, 'wb') as f:
+        f.write(header + body + sections)
+    return path
+
+
+def check_ids():
+    first = b'\x03Frame accepted: %lu numbers queued.\r\n\0'
+    second = b'\x04Analyzing digit %c (%d)...\r\n\0'
+    addr = 0x08004000
+    layouts = [
+        # GNU ld keeps the section by name and defines __start_log_messages.
+        ('GNU ld', 'log_messages', addr, [('__start_log_messages', addr),
+                                          ('log_message.0', addr),
+                                          ('log_message.1', addr + len(first))]),
+        # armlink merges it into a load region and names statics by function.
+        ('armlink', 'ER_RO', addr - 0x40, [('log_messages$$Base', addr),
+                                           ('process_frame.log_message', addr),
+                                           ('perform_current_digit_analysis.log_message', addr + len(first))]),
+        # Neither base symbol: the first message starts the section.
+        ('no base symbol', 'ER_RO', addr - 0x40, [('process_frame.log_message', addr),
+                                                  ('perform_current_digit_analysis.log_message', addr + len(first))]),
+    ]
+    for name, section_name, section_addr, symbols in layouts:
+        padding = bytes(addr - section_addr)
+        path = elf(section_name, section_addr, padding + first + second, symbols)
+        try:
+            messages = logdecode.load_messages(path)
+        finally:
+            os.unlink(path)
+        expected = {0: (3, first[1:-1].decode()), len(first): (4, second[1:-1].decode())}
+        if messages != expected:
+            print('test_logdecode: %s: messages %r, expected %r' % (name, messages, expected),
+                  file=sys.stderr)
+            return False
+    return True
+
+
+def check(name, stream, expected):
+    for chunk_size in (None, 1, 3):
+        got = decode(stream, chunk_size)
+        for text in expected:
+            if text not in got:
+                print('test_logdecode: %s (chunks of %s): %r missing from %r'
+                      % (name, chunk_size, text, got), file=sys.stderr)
+                return False
+    return True
+
+
+def main():
+    accepted = frame(0x00, 5, 3)
+    digit = frame(0xA6, 500, ord('7'), 14)  # 7 zigzag encoded
+    cut = frame(0xA6, 20, ord('4'), 8)[:4]  # Opening 0x00 and the start only
+    ok = check('cut record', b'Hello\r\n' + cut + accepted + b'Idle\r\n' + digit,
+               ['Hello\r\n', 'Frame accepted: 3 numbers queued.', 'Idle\r\n',
+                'Analyzing digit 7 (7)...', '[skipped'])
+    ok = check('start mid-record', accepted[3:] + b'Idle\r\n' + digit,
+               ['Idle\r\n', 'Analyzing digit 7 (7)...']) and ok
+    ok = check('unknown message', frame(0x999, 1, 1) + accepted + b'Idle\r\n',
+               ['Frame accepted: 3 numbers queued.', 'Idle\r\n']) and ok
+    ok = check('timestamps', accepted + digit, ['[     0.005] I', '[     0.505] D']) and ok
+    ok = check_ids() and ok
+    if not ok:
+        return 1
+    print('test_logdecode: decoding recovers after cut records; IDs count from the section start')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,164 @@
+/*!
+ * \file      test_queue_spsc.c
+ * \brief     Two-thread stress test of the lock-free queue.
+ *
+ * A producer thread and a consumer thread stand in for the UART
+ * interrupt and the main loop. The producer pushes a long pseudo-random
+ * byte stream through a small queue with a random mix of single-item
+ * and bulk adds; the consumer takes it off with a random mix of
+ * single-item removes, bulk removes and peek/commit, and checks every
+ * byte against the same stream. The random sizes make the two sides
+ * meet at every position of the data array. A lost, duplicated or
+ * reordered byte shows up as a mismatch, and the totals must agree at
+ * the end.
+ *
+ * SPSC_BYTES sets the length of the stream and SPSC_SIZE the size of
+ * the queue.
+ */
+#include "queue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef SPSC_BYTES
+#define SPSC_BYTES 400000000ULL
+#endif
+
+#ifndef SPSC_SIZE
+#define SPSC_SIZE 64
+#endif
+
+#define SPSC_CHUNK 24 // Largest bulk operation
+
+static Queue queue;
+
+// Small xorshift generator, one state per thread.
+static uint32_t random_next(uint32_t *state) {
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Byte n of the test stream. Any loss or duplication shifts the
+// consumer's position in the stream and is caught on the next byte.
+static uint8_t stream_byte(uint64_t n) {
+	uint64_t x = (n + 1) * 0x9E3779B97F4A7C15ULL;
+	return (uint8_t)(x >> 56);
+}
+
+static void *producer(void *arg) {
+	uint8_t chunk[SPSC_CHUNK];
+	uint64_t sent = 0;
+	uint32_t state = 0x12345678;
+	uint32_t i;
+
+	(void)arg;
+	while (sent < SPSC_BYTES) {
+		uint32_t choice = random_next(&state);
+
+		if ((choice & 1) == 0) {
+			if (queue_enqueue(&queue, stream_byte(sent))) {
+				sent++;
+			} else {
+				sched_yield();
+			}
+		} else {
+			uint32_t count = 1 + (choice >> 8) % SPSC_CHUNK;
+			uint32_t added;
+
+			if (SPSC_BYTES - sent < count) {
+				count = (uint32_t)(SPSC_BYTES - sent);
+			}
+			for (i = 0; i < count; i++) {
+				chunk[i] = stream_byte(sent + i);
+			}
+			added = queue_enqueue_n(&queue, chunk, count);
+			if (added == 0) {
+				sched_yield();
+			}
+			sent += added;
+		}
+	}
+	return 0;
+}
+
+static int check(uint64_t position, uint8_t got) {
+	if (got != stream_byte(position)) {
+		fprintf(stderr, "test_queue_spsc: byte %llu is 0x%02X, expected 0x%02X\n",
+		        (unsigned long long)position, got, stream_byte(position));
+		return 0;
+	}
+	return 1;
+}
+
+int main(void) {
+	pthread_t thread;
+	uint8_t chunk[SPSC_CHUNK];
+	uint64_t received = 0;
+	uint32_t state = 0x9ABCDEF0;
+	uint32_t count;
+	uint32_t i;
+
+	if (!queue_init(&queue, SPSC_SIZE)) {
+		fprintf(stderr, "test_queue_spsc: queue_init failed\n");
+		return 1;
+	}
+	if (pthread_create(&thread, 0, producer, 0) != 0) {
+		fprintf(stderr, "test_queue_spsc: pthread_create failed\n");
+		return 1;
+	}
+
+	while (received < SPSC_BYTES) {
+		uint32_t choice = random_next(&state);
+
+		switch (choice % 3) {
+		case 0: {
+			uint8_t c;
+
+			count = queue_dequeue(&queue, &c);
+			if (count && !check(received, c)) {
+				return 1;
+			}
+			break;
+		}
+		case 1:
+			count = queue_dequeue_n(&queue, chunk, 1 + (choice >> 8) % SPSC_CHUNK);
+			for (i = 0; i < count; i++) {
+				if (!check(received + i, chunk[i])) {
+					return 1;
+				}
+			}
+			break;
+		default: {
+			const uint8_t *region;
+
+			count = queue_peek_contiguous(&queue, &region);
+			for (i = 0; i < count; i++) {
+				if (!check(received + i, region[i])) {
+					return 1;
+				}
+			}
+			queue_commit(&queue, count);
+			break;
+		}
+		}
+		if (count == 0) {
+			sched_yield();
+		}
+		received += count;
+	}
+
+	pthread_join(thread, 0);
+	if (!queue_is_empty(&queue)) {
+		fprintf(stderr, "test_queue_spsc: %u bytes left over\n", (unsigned)queue_count(&queue));
+		return 1;
+	}
+	printf("test_queue_spsc: %llu bytes through a %u byte queue, none lost or duplicated\n",
+	       (unsigned long long)received, (unsigned)SPSC_SIZE);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*!
+ * \file      bench_printf.c
+ * \brief     Host benchmark of uart_printf() against sprintf().
+ *
+ * Times the two messages main.c used to build with sprintf(): the
+ * button report and the per-digit message. Each is sent both ways
+ * into the status channel of a UART built against the register
+ * stand-ins in tests/mock:
+ *
+ *  - uart_printf:     uart_printf() straight into the transmit ring;
+ *  - sprintf + write: sprintf() into a stack buffer, then uart_write().
+ *
+ * The transmit ring is enlarged and emptied between batches, outside
+ * the timed region, so neither way ever waits for the line. Results
+ * are printed as a table and written as CSV to the file named on the
+ * command line (bench_printf.csv by default).
+ *
+ * These are host figures. bench_printf_target.c times the same calls
+ * on the board in core clock cycles.
+ */
+#include "platform.h"
+#include "uart.h"
+#include <stdio.h>
+#include <time.h>
+
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 2000000UL
+#endif
+
+#define BENCH_BATCH 1000 // Calls between emptying the ring
+
+static Uart uart;
+
+static double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Stands in for the line: throws away everything queued.
+static void drain(void) {
+	Queue *queue = &uart.tx[UART_CHANNEL_STATUS].queue;
+
+	queue_commit(queue, queue_count(queue));
+}
+
+static void button_printf(uint32_t i) {
+	uart_printf(&uart, "\r\nButton Press: LED functionality %s. Press count: %lu\r\n",
+	            (i & 1) ? "ENABLED" : "DISABLED", (unsigned long)i);
+}
+
+static void button_sprintf(uint32_t i) {
+	char msg[80];
+	int length = sprintf(msg, "\r\nButton Press: LED functionality %s. Press count: %lu\r\n",
+	                     (i & 1) ? "ENABLED" : "DISABLED", (unsigned long)i);
+
+	uart_write(&uart, msg, length);
+}
+
+static void digit_printf(uint32_t i) {
+	uart_printf(&uart, "Analyzing digit %c (%d)...\r\n", (char)('0' + i % 10), (int)(i % 10));
+}
+
+static void digit_sprintf(uint32_t i) {
+	char msg[30];
+	int length = sprintf(msg, "Analyzing digit %c (%d)...\r\n", (char)('0' + i % 10), (int)(i % 10));
+
+	uart_write(&uart, msg, length);
+}
+
+static const struct {
+	const char *message;
+	const char *method;
+	void (*send)(uint32_t i);
+} cases[] = {
+	{ "button", "uart_printf",     button_printf },
+	{ "button", "sprintf + write", button_sprintf },
+	{ "digit",  "uart_printf",     digit_printf },
+	{ "digit",  "sprintf + write", digit_sprintf },
+};
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "bench_printf.csv";
+	FILE *csv = fopen(path, "w");
+	uint32_t c;
+
+	if (csv == 0) {
+		perror(path);
+		return 1;
+	}
+	uart_init(&uart, UART_PORT_2, 115200);
+	uart_enable(&uart);
+
+	fprintf(csv, "message,method,calls,ns_per_call\n");
+	printf("%-8s %-16s %12s\n", "message", "method", "ns/call");
+	for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		double elapsed = 0;
+		uint32_t i = 0;
+
+		while (i < BENCH_CALLS) {
+			double start = now_ns();
+			uint32_t end = i + BENCH_BATCH;
+
+			for (; i < end; i++) {
+				cases[c].send(i);
+			}
+			elapsed += now_ns() - start;
+			drain();
+		}
+		printf("%-8s %-16s %12.1f\n", cases[c].message, cases[c].method, elapsed / i);
+		fprintf(csv, "%s,%s,%u,%.2f\n", cases[c].message, cases[c].method, (unsigned)i, elapsed / i);
+	}
+	fclose(csv);
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*!
+ * \file      bench_printf_target.c
+ * \brief     On-target benchmark of uart_printf() against sprintf().
+ *
+ * The board counterpart of bench_printf.c: a program of its own that
+ * times the same two messages in core clock cycles with the DWT cycle
+ * counter, and prints the average per call on USART2. The output is
+ * flushed before each timed call, so that neither way waits for the
+ * line.
+ *
+ * It replaces main.c in the build: in a copy of the Keil target,
+ * exclude main.c from the build and add this file instead. The drivers
+ * are used unchanged.
+ */
+#include "platform.h"
+#include "uart.h"
+#include "cycles.h"
+#include <stdio.h>
+
+#define BENCH_CALLS 100 // Calls averaged per figure
+#define BENCH_BAUD  115200
+
+static Uart console;
+
+int main(void) {
+	uint32_t button_printf = 0, button_sprintf = 0;
+	uint32_t digit_printf = 0, digit_sprintf = 0;
+	char msg[80];
+	uint32_t start;
+	uint32_t i;
+	int length;
+
+	cycles_init();
+	uart_init(&console, UART_PORT_2, BENCH_BAUD);
+	uart_enable(&console);
+	__enable_irq(); // The transmit interrupts drain the ring
+
+	for (i = 0; i < BENCH_CALLS; i++) {
+		uart_flush(&console);
+		start = cycles_now();
+		uart_printf(&console, "\r\nButton Press: LED functionality %s. Press count: %lu\r\n", "ENABLED", (unsigned long)i);
+		button_printf += cycles_now() - start;
+
+		uart_flush(&console);
+		start = cycles_now();
+		length = sprintf(msg, "\r\nButton Press: LED functionality %s. Press count: %lu\r\n", "ENABLED", (unsigned long)i);
+		uart_write(&console, msg, length);
+		button_sprintf += cycles_now() - start;
+
+		uart_flush(&console);
+		start = cycles_now();
+		uart_printf(&console, "Analyzing digit %c (%d)...\r\n", (char)('0' + i % 10), (int)(i % 10));
+		digit_printf += cycles_now() - start;
+
+		uart_flush(&console);
+		start = cycles_now();
+		length = sprintf(msg, "Analyzing digit %c (%d)...\r\n", (char)('0' + i % 10), (int)(i % 10));
+		uart_write(&console, msg, length);
+		digit_sprintf += cycles_now() - start;
+	}
+	uart_flush(&console);
+	uart_printf(&console, "Cycles per call, uart_printf / sprintf + uart_write: button %lu / %lu, digit %lu / %lu\r\n",
+	            (unsigned long)(button_printf / BENCH_CALLS), (unsigned long)(button_sprintf / BENCH_CALLS),
+	            (unsigned long)(digit_printf / BENCH_CALLS), (unsigned long)(digit_sprintf / BENCH_CALLS));
+
+	while (1) {
+		__WFI();
+	}
+}
@@ -0,0 +1,184 @@
+/*!
+ * \file      bench_queue.c
+ * \brief     Host benchmark of the queue operations.
+ *
+ * Times three access patterns over a range of queue sizes, with
+ * drivers/queue.c compiled unchanged:
+ *
+ *  - single:      fill the queue with queue_enqueue(), then empty it
+ *                 with queue_dequeue();
+ *  - bulk:        the same with queue_enqueue_n() and queue_dequeue_n()
+ *                 in blocks of BENCH_BLOCK bytes;
+ *  - interleaved: one queue_enqueue() then one queue_dequeue(), as
+ *                 when the main loop keeps up with the UART interrupt.
+ *
+ * The single and interleaved patterns are also run through out-of-line
+ * copies of the operations (bench_queue_call.c), to show what inlining
+ * them in queue.h saves. The Makefile builds the benchmark both
+ * optimised and at -O0, the level the Keil project builds at.
+ *
+ * Each byte moved through the queue counts as one operation. The
+ * results are printed as a table and written as CSV to the file named
+ * on the command line (bench_queue.csv by default).
+ *
+ * Only power-of-two sizes can be measured: queue_init() rejects any
+ * other size.
+ */
+#include "bench_queue_call.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef BENCH_BYTES
+#define BENCH_BYTES 200000000UL // Bytes moved per measurement
+#endif
+
+#define BENCH_BLOCK 32
+
+static const uint32_t sizes[] = { 16, 64, 256, 1024, 4096 };
+
+// Accumulates what was dequeued so the compiler cannot drop the work.
+static volatile uint32_t sink;
+
+typedef uint32_t (*Pattern)(Queue *queue, uint32_t bytes);
+
+static double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t run_single(Queue *queue, uint32_t bytes) {
+	uint32_t size = queue->mask + 1;
+	uint32_t sum = 0;
+	uint32_t moved;
+	uint8_t c = 0;
+	uint32_t i;
+
+	for (moved = 0; moved < bytes; moved += size) {
+		for (i = 0; i < size; i++) {
+			queue_enqueue(queue, (uint8_t)i);
+		}
+		while (queue_dequeue(queue, &c)) {
+			sum += c;
+		}
+	}
+	sink += sum;
+	return moved;
+}
+
+static uint32_t run_single_call(Queue *queue, uint32_t bytes) {
+	uint32_t size = queue->mask + 1;
+	uint32_t sum = 0;
+	uint32_t moved;
+	uint8_t c = 0;
+	uint32_t i;
+
+	for (moved = 0; moved < bytes; moved += size) {
+		for (i = 0; i < size; i++) {
+			queue_enqueue_call(queue, (uint8_t)i);
+		}
+		while (queue_dequeue_call(queue, &c)) {
+			sum += c;
+		}
+	}
+	sink += sum;
+	return moved;
+}
+
+static uint32_t run_bulk(Queue *queue, uint32_t bytes) {
+	static uint8_t block[BENCH_BLOCK];
+	uint32_t size = queue->mask + 1;
+	uint32_t sum = 0;
+	uint32_t moved;
+	uint32_t i;
+
+	for (moved = 0; moved < bytes; moved += size) {
+		for (i = 0; i < size; i += BENCH_BLOCK) {
+			queue_enqueue_n(queue, block, BENCH_BLOCK);
+		}
+		while ((i = queue_dequeue_n(queue, block, BENCH_BLOCK)) != 0) {
+			sum += block[i - 1];
+		}
+	}
+	sink += sum;
+	return moved;
+}
+
+static uint32_t run_interleaved(Queue *queue, uint32_t bytes) {
+	uint32_t sum = 0;
+	uint32_t moved;
+	uint8_t c = 0;
+
+	for (moved = 0; moved < bytes; moved++) {
+		queue_enqueue(queue, (uint8_t)moved);
+		queue_dequeue(queue, &c);
+		sum += c;
+	}
+	sink += sum;
+	return moved;
+}
+
+static uint32_t run_interleaved_call(Queue *queue, uint32_t bytes) {
+	uint32_t sum = 0;
+	uint32_t moved;
+	uint8_t c = 0;
+
+	for (moved = 0; moved < bytes; moved++) {
+		queue_enqueue_call(queue, (uint8_t)moved);
+		queue_dequeue_call(queue, &c);
+		sum += c;
+	}
+	sink += sum;
+	return moved;
+}
+
+static const struct {
+	const char *name;
+	Pattern run;
+} patterns[] = {
+	{ "single",           run_single },
+	{ "single-call",      run_single_call },
+	{ "bulk",             run_bulk },
+	{ "interleaved",      run_interleaved },
+	{ "interleaved-call", run_interleaved_call },
+};
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "bench_queue.csv";
+	FILE *csv = fopen(path, "w");
+	uint32_t p;
+	uint32_t s;
+
+	if (csv == 0) {
+		perror(path);
+		return 1;
+	}
+	fprintf(csv, "pattern,size,bytes,ns_per_op,ops_per_sec\n");
+	printf("%-17s %6s %10s %14s\n", "pattern", "size", "ns/op", "ops/sec");
+
+	for (p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			Queue queue;
+			uint32_t moved;
+			double start;
+			double ns;
+
+			if (!queue_init(&queue, sizes[s])) {
+				fprintf(stderr, "queue_init(%u) failed\n", (unsigned)sizes[s]);
+				return 1;
+			}
+			patterns[p].run(&queue, BENCH_BYTES / 10); // Warm up
+			start = now_ns();
+			moved = patterns[p].run(&queue, BENCH_BYTES);
+			ns = (now_ns() - start) / moved;
+			free(queue.data);
+
+			printf("%-17s %6u %10.2f %14.0f\n", patterns[p].name, (unsigned)sizes[s], ns, 1e9 / ns);
+			fprintf(csv, "%s,%u,%u,%.3f,%.0f\n", patterns[p].name, (unsigned)sizes[s], (unsigned)moved, ns, 1e9 / ns);
+		}
+	}
+	fclose(csv);
+	return 0;
+}
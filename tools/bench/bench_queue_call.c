@@ -0,0 +1,12 @@
+// Out-of-line versions of the single-item queue operations, as queue.c
+// provided them before they moved into queue.h. Built as a separate
+// file so the calls in bench_queue.c cannot be inlined.
+#include "bench_queue_call.h"
+
+int queue_enqueue_call(Queue *queue, uint8_t item) {
+	return queue_enqueue(queue, item);
+}
+
+int queue_dequeue_call(Queue *queue, uint8_t *item) {
+	return queue_dequeue(queue, item);
+}
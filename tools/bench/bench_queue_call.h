@@ -0,0 +1,8 @@
+#ifndef BENCH_QUEUE_CALL_H
+#define BENCH_QUEUE_CALL_H
+#include "queue.h"
+
+int queue_enqueue_call(Queue *queue, uint8_t item);
+int queue_dequeue_call(Queue *queue, uint8_t *item);
+
+#endif // BENCH_QUEUE_CALL_H
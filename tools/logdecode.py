@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""Decodes binary log records (LOG_BINARY, see drivers/log.h).
+
+Reads the UART output from a file, stdin or a serial port, replaces each
+record with its text and passes everything else through unchanged.
+The messages are read from the .axf (ELF) file the firmware was built
+into, so it must be the same build.
+
+    logdecode.py Objects/lab2.axf capture.bin
+    logdecode.py Objects/lab2.axf --port COM5 --baud 115200
+"""
+import argparse
+import struct
+import sys
+
+LEVELS = {1: 'E', 2: 'W', 3: 'I', 4: 'D', 5: 'T'}
+
+
+class Elf32:
+    """Just enough of an ELF32 little-endian reader for the string table."""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError('%s is not a 32-bit little-endian ELF file' % path)
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            fields = struct.unpack_from('<IIIIIIIIII', self.data, shoff + i * shentsize)
+            self.sections.append(dict(zip(
+                ('name', 'type', 'flags', 'addr', 'offset', 'size', 'link', 'info', 'align', 'entsize'),
+                fields)))
+        names = self.sections[shstrndx]
+        for section in self.sections:
+            section['name'] = self.cstring(names['offset'] + section['name'])
+
+    def cstring(self, offset):
+        end = self.data.index(b'\0', offset)
+        return self.data[offset:end].decode('latin-1')
+
+    def file_offset(self, addr):
+        for section in self.sections:
+            # SHT_PROGBITS sections hold the bytes loaded at their address.
+            if section['type'] == 1 and section['addr'] <= addr < section['addr'] + section['size']:
+                return section['offset'] + addr - section['addr']
+        return None
+
+    def symbols(self):
+        for section in self.sections:
+            if section['type'] != 2:  # SHT_SYMTAB
+                continue
+            strtab = self.sections[section['link']]
+            for i in range(section['size'] // 16):
+                name, value, size, info, other, shndx = struct.unpack_from(
+                    '<IIIBBH', self.data, section['offset'] + i * 16)
+                yield self.cstring(strtab['offset'] + name), value
+
+
+def load_messages(path):
+    """Maps each message ID, its offset in the log_messages section, to
+    (level, format)."""
+    elf = Elf32(path)
+    symbols = list(elf.symbols())
+    # Each message is a static object named log_message, whose (local)
+    # symbol survives linking with both armlink and GNU ld, qualified with
+    # the function or a number: handle_idle_state.log_message, log_message.3.
+    addresses = {value for name, value in symbols if 'log_message' in name.split('.')}
+    section = next((s for s in elf.sections if s['name'] == 'log_messages'), None)
+    if not addresses and section is not None:
+        # Stripped: walk the section instead. A level is never zero, so
+        # zero bytes are padding between messages.
+        offset = section['offset']
+        end = offset + section['size']
+        while offset < end:
+            if elf.data[offset] == 0:
+                offset += 1
+                continue
+            addresses.add(section['addr'] + offset - section['offset'])
+            offset = elf.data.index(b'\0', offset + 1) + 1
+    # log.c counts IDs from the start of the section, which armlink names
+    # log_messages$$Base and GNU ld __start_log_messages. armlink merges
+    # the section into a load region, so without the symbol the first
+    # message, which the section starts with, stands in for it.
+    bases = [value for name, value in symbols if name in ('log_messages$$Base', '__start_log_messages')]
+    if bases:
+        base = bases[0]
+    elif section is not None:
+        base = section['addr']
+    elif addresses:
+        base = min(addresses)
+    messages = {}
+    for addr in addresses:
+        offset = elf.file_offset(addr)
+        if offset is not None:
+            messages[addr - base] = (elf.data[offset], elf.cstring(offset + 1))
+    return messages
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + (1 if code == 1 else 0):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def varint(record, pos):
+    value = shift = 0
+    while True:
+        byte = record[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, pos
+
+
+def render(fmt, record, pos):
+    """Formats like uart_printf(), taking the arguments from the record."""
+    out = []
+    i = 0
+    while i < len(fmt):
+        c = fmt[i]
+        i += 1
+        if c != '%':
+            out.append(c)
+            continue
+        if i < len(fmt) and fmt[i] == 'l':
+            i += 1
+        if i >= len(fmt):
+            break
+        conversion = fmt[i]
+        i += 1
+        if conversion not in 'cdusx':
+            out.append(conversion)
+            continue
+        if pos >= len(record):
+            out.append('?')  # Left out of a full record
+            continue
+        if conversion == 's':
+            length = record[pos]
+            out.append(record[pos + 1:pos + 1 + length].decode('latin-1'))
+            pos += 1 + length
+            continue
+        value, pos = varint(record, pos)
+        if conversion == 'd':
+            value = (value >> 1) ^ -(value & 1)
+        out.append(chr(value) if conversion == 'c' else
+                   '%x' % value if conversion == 'x' else str(value))
+    return ''.join(out)
+
+
+def decode_record(messages, record, clock):
+    """Returns the text of a record, or None if it is not one of ours."""
+    try:
+        message_id, pos = varint(record, 0)
+        delta, pos = varint(record, pos)
+        level, fmt = messages[message_id]
+        text = render(fmt, record, pos)
+    except (IndexError, KeyError, ValueError, OverflowError):
+        return None
+    clock[0] += delta
+    return '[%10.3f] %s %s' % (clock[0] / 1000.0, LEVELS.get(level, '?'), text)
+
+
+def skipped(data):
+    """Text for bytes between two 0x00 that did not decode as a record."""
+    if all(32 <= byte < 127 or byte in b'\r\n\t' for byte in data):
+        return data  # Plain text, seen after starting mid-record
+    return b'[skipped %d bytes]\r\n' % len(data)
+
+
+def decode_stream(messages, chunks, out):
+    clock = [0]
+    in_record = False
+    record = bytearray()
+    for chunk in chunks:
+        text = bytearray()
+        for byte in chunk:
+            if byte == 0:
+                if in_record and record:
+                    decoded = cobs_decode(bytes(record))
+                    line = decode_record(messages, decoded, clock) if decoded is not None else None
+                    if line is not None:
+                        text += line.encode('latin-1')
+                        in_record = False
+                    else:
+                        # Part of a record that was cut short (or text, if
+                        # we started mid-record), so this 0x00 did not end
+                        # a record: it starts the next one.
+                        text += skipped(record)
+                else:
+                    in_record = True  # Back-to-back delimiters; this one opens the record
+                record.clear()
+            elif in_record:
+                record.append(byte)
+            else:
+                text.append(byte)
+        out.write(text.decode('latin-1'))
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('elf', help='.axf/.elf file of the running firmware')
+    parser.add_argument('capture', nargs='?', default='-', help='captured UART output (default stdin)')
+    parser.add_argument('--port', help='read from this serial port instead (needs pyserial)')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    messages = load_messages(args.elf)
+    if args.port:
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+        chunks = iter(lambda: port.read(256) or b'', None)
+    elif args.capture == '-':
+        chunks = iter(lambda: sys.stdin.buffer.read1(256), b'')
+    else:
+        capture = open(args.capture, 'rb')
+        chunks = iter(lambda: capture.read(4096), b'')
+    try:
+        decode_stream(messages, chunks, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()